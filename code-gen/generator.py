@@ -3,14 +3,51 @@ import argparse
 from pathlib import Path
 
 
+# Pseudo-instructions standing for pairs of instructions fused by the block builder (see
+# Decoder::fuse). Their executors are written by hand; the values are their disassembly.
+FUSED_INSTRUCTIONS : dict[str, str] = {
+    "lui_addi": "fmt::format(\"lui+addi x{}, {:#x}\", rd, imm)",
+    "lui_addiw": "fmt::format(\"lui+addiw x{}, {:#x}\", rd, imm)",
+    "auipc_jalr": "fmt::format(\"auipc+jalr x{}, x{}, {:#x}\", rd, rs1, imm)",
+    "auipc_ld": "fmt::format(\"auipc+ld x{}, x{}, {:#x}\", rd, rs1, imm)",
+    "slli_srli": "fmt::format(\"slli+srli x{}, x{}, {:#x}\", rd, rs1, imm)",
+    "slt_bnez": "fmt::format(\"slt+bnez x{}, x{}, x{}, {:#x}\", rd, rs1, rs2, to_signed(imm))",
+    "slt_beqz": "fmt::format(\"slt+beqz x{}, x{}, x{}, {:#x}\", rd, rs1, rs2, to_signed(imm))",
+    "sltu_bnez": "fmt::format(\"sltu+bnez x{}, x{}, x{}, {:#x}\", rd, rs1, rs2, to_signed(imm))",
+    "sltu_beqz": "fmt::format(\"sltu+beqz x{}, x{}, x{}, {:#x}\", rd, rs1, rs2, to_signed(imm))",
+}
+
+
+# The ID of encodings that are not valid instructions; its executor raises an exception
+ILLEGAL_INSTRUCTION : str = "illegal"
+
+
+# Handlers selected on decoding for operand forms that are cheaper to execute than the general
+# one: instructions whose only effect is writing x0 are not executed at all, and operations on x0
+# produce constants. Their executors are written by hand.
+RD_X0_HANDLERS : dict[str, str] = {
+    id: "nop" for id in ["add", "addi", "addiw", "addw", "and", "andi", "auipc", "lui", "or",
+                         "ori", "sll", "slli", "slliw", "sllw", "slt", "slti", "sltiu", "sltu",
+                         "sra", "srai", "sraiw", "sraw", "srl", "srli", "srliw", "srlw", "sub",
+                         "subw", "xor", "xori"]
+} | {"jal": "j", "jalr": "jr"}
+
+RS1_X0_HANDLERS : dict[str, str] = {"addi": "li", "addiw": "li", "ori": "li", "xori": "li"}
+
+SPECIALIZED_HANDLERS : list[str] = list(dict.fromkeys([*RD_X0_HANDLERS.values(),
+                                                       *RS1_X0_HANDLERS.values()]))
+
+
 def generate_enum(data : dict[str, dict], output_path : str) -> None:
 
-    enum_values : list[str] = [f"k{id.upper()}" for id in data.keys()]
+    ids : list[str] = list(data.keys()) + [ILLEGAL_INSTRUCTION] + list(FUSED_INSTRUCTIONS.keys())
+
+    enum_values : list[str] = [f"k{id.upper()}" for id in ids]
     enum_values.append("kEndID")
     enum : str = ",\n    ".join(enum_values)
 
     switch_values : list[str] = [" " *  8 + f"case k{id.upper()}:\n" + \
-                                 " " * 12 + f"return \"{id.upper()}\";" for id in data.keys()]
+                                 " " * 12 + f"return \"{id.upper()}\";" for id in ids]
     switch : str = "\n".join(switch_values)
 
     content : str = f"""/*
@@ -20,16 +57,20 @@ def generate_enum(data : dict[str, dict], output_path : str) -> None:
 #ifndef IDENTIFIERS_HPP
 #define IDENTIFIERS_HPP
 
+#include <cstdint>
 #include <utility>
 
 namespace yarvs
 {{
 
-enum InstrID
+enum InstrID : std::uint8_t
 {{
     {enum}
 }};
 
+// fused pseudo-instructions follow real ones
+inline constexpr InstrID kFirstFusedID = k{next(iter(FUSED_INSTRUCTIONS)).upper()};
+
 inline const char *enum_to_str(InstrID id) noexcept
 {{
     switch (id)
@@ -49,138 +90,252 @@ inline const char *enum_to_str(InstrID id) noexcept
         enum_file.write(content)
 
 
-def generate_single_mask_cases(single_mask_opcodes : list[tuple[int, int]]) -> str:
-    cases : list[str] = []
+INSTR_BIT_LEN : int = 32
+FUNCT3_LSB : int = 12
+FUNCT3_MASK : int = 0b111 << FUNCT3_LSB
 
-    for opcode, mask in single_mask_opcodes:
-        case = " " *  8 + f"case {opcode:#x}:" + "\n" + \
-               " " * 12 + f"if (auto decoder = get_decoder(raw_instr & {mask:#x})) [[likely]]\n" + \
-               " " * 16 + "return decoder(raw_instr);\n" + \
-               " " * 12 + "break;"
-        cases.append(case)
 
-    return "\n".join(cases)
+def group_index(opcode : int, funct3 : int) -> int:
+    # bits 1:0 of the opcode are 0b11 for all 32-bit instructions and are checked per entry
+    return (opcode >> 2) | (funct3 << 5)
 
 
-def generate_multiple_mask_cases(multiple_mask_opcodes : list[tuple[int, list[int]]]) -> str:
-    cases : list[str] = []
+def distinguishes(mask : int, infos : list[dict]) -> bool:
+    for i, first in enumerate(infos):
+        for second in infos[i + 1:]:
+            common : int = mask & int(first["mask"], 16) & int(second["mask"], 16)
+            if int(first["match"], 16) & common == int(second["match"], 16) & common:
+                return False
+    return True
 
-    for opcode, masks in multiple_mask_opcodes:
-        masks : list[str] = [f"mask_type{{{mask:#x}}}" for mask in sorted(masks, reverse=True)]
-        case : str = " " *  8 + f"case {opcode:#x}:\n" + \
-                     " " * 12 + f"for (auto mask : {{{", ".join(masks)}}})\n" + \
-                     " " * 16 + "if (auto decoder = get_decoder(raw_instr & mask))\n" + \
-                     " " * 20 + "return decoder(raw_instr);\n" + \
-                     " " * 12 + "break;"
-        cases.append(case)
 
-    return "\n".join(cases)
+def find_slice(infos : list[dict]) -> tuple[int, int]:
+    """The narrowest contiguous bit slice of the instructions telling them apart: (lsb, width)"""
+    if len(infos) == 1:
+        return 0, 0
 
+    for width in range(1, INSTR_BIT_LEN):
+        for lsb in range(7, INSTR_BIT_LEN - width + 1):
+            if distinguishes(((1 << width) - 1) << lsb, infos):
+                return lsb, width
+
+    raise Exception(f"instructions {[info["id"] for info in infos]} are ambiguous")
 
-def generate_decoding_method(data : dict[str, dict]) -> str:
-    OPCODE_LEN : int = 7
-    INSTR_BIT_LEN : int = 32
 
-    opcode_to_masks : dict[int, list[int]] = dict()
-    for info in data.values():
-        opcode : int = int(info["encoding"][INSTR_BIT_LEN - OPCODE_LEN : INSTR_BIT_LEN], 2)
+def generate_decoding_tables(data : dict[str, dict]) -> tuple[list[str], list[str]]:
+    N_GROUPS : int = 256
+
+    groups : list[list[dict]] = [[] for _ in range(N_GROUPS)]
+    for id, info in data.items():
+        opcode : int = int(info["match"], 16) & 0x7f
         mask : int = int(info["mask"], 16)
-        if opcode_to_masks.get(opcode):
-            if mask not in opcode_to_masks[opcode]:
-                opcode_to_masks[opcode].append(mask)
-        else:
-            opcode_to_masks[opcode] = [mask]
-
-    singe_mask_opcodes : list[tuple[int, int]] = \
-        [(opcode, masks[0]) for opcode, masks in opcode_to_masks.items() if len(masks) == 1]
-    multiple_mask_opcodes : list[tuple[int, list[int]]] = \
-        list(filter(lambda pair : len(pair[1]) > 1, opcode_to_masks.items()))
-
-    return f"""Instruction Decoder::decode(RawInstruction raw_instr)
-{{
-    switch (auto opcode = get_bits<6, 0>(raw_instr))
-    {{
-{generate_single_mask_cases(singe_mask_opcodes)}
-{generate_multiple_mask_cases(multiple_mask_opcodes)}
-        default: [[unlikely]]
-            throw std::invalid_argument{{
-                fmt::format("unknown opcode {{:#x}} of instruction {{:#x}}", opcode, raw_instr)}};
-    }}
+        # instructions without funct3 (lui, auipc, jal) belong to all the groups of their opcode
+        for funct3 in range(8):
+            funct3_match : int = (int(info["match"], 16) & FUNCT3_MASK) >> FUNCT3_LSB
+            if mask & FUNCT3_MASK and funct3_match != funct3:
+                continue
+            groups[group_index(opcode, funct3)].append(dict(info, id=id))
+
+    illegal_entry : str = "{0x0, 0x0, &decode_instr<InstrID::kILLEGAL>, InstrID::kILLEGAL}"
+
+    # entry 0 is shared by empty groups
+    entries : list[str] = [" " * 4 + illegal_entry]
+    group_lines : list[str] = []
+    for index, infos in enumerate(groups):
+        opcode : int = ((index & 0x1f) << 2) | 0b11
+        funct3 : int = index >> 5
+        comment : str = f"// opcode {opcode:#04x}, funct3 {funct3}"
+
+        if not infos:
+            group_lines.append(" " * 4 + "{.offset = 0, .mask = 0x0, .shift = 0}, " + comment)
+            continue
+
+        lsb, width = find_slice(infos)
+        group_lines.append(" " * 4 + f"{{.offset = {len(entries)}, " + \
+                           f".mask = {(1 << width) - 1:#x}, .shift = {lsb}}}, {comment}: " + \
+                           ", ".join(info["id"] for info in infos))
+
+        for value in range(1 << width):
+            slice_match : int = value << lsb
+            slice_mask : int = ((1 << width) - 1) << lsb
+            entry : str = illegal_entry
+            for info in infos:
+                common : int = slice_mask & int(info["mask"], 16)
+                if int(info["match"], 16) & common == slice_match & common:
+                    id : str = f"InstrID::k{info["id"].upper()}"
+                    entry = f"{{{info["mask"]}, {info["match"]}, &decode_instr<{id}>, {id}}}"
+                    break
+            entries.append(" " * 4 + entry)
+
+    if len(entries) > 0xffff:
+        raise Exception("the decoding table is too large")
+
+    return group_lines, entries
+
+
+def generate_decoding_method(data : dict[str, dict]) -> str:
+    group_lines, entries = generate_decoding_tables(data)
 
-    throw std::invalid_argument{{fmt::format("unknown instruction: {{:#x}}", raw_instr)}};
+    return f"""const std::array<Decoder::Group, Decoder::kNGroups> Decoder::kGroups = {{{{
+{"\n".join(group_lines)}
+}}}};
+
+const Decoder::Entry Decoder::kEntries[] = {{
+{",\n".join(entries)}
+}};
+
+/*
+ * Instructions are looked up in two tables. The first one is indexed by opcode and funct3 and
+ * describes a group of instructions: the location of its entries in the second table and the bit
+ * slice telling them apart (e.g. bit 30 for add and sub). The entry found is checked against all
+ * the fixed bits of the instruction, so that any unknown encoding is decoded as kILLEGAL.
+ */
+Instruction Decoder::decode(RawInstruction raw_instr) noexcept
+{{
+    const auto &group = kGroups[get_bits<6, 2>(raw_instr) | (get_bits<14, 12>(raw_instr) << 5)];
+    const auto &entry = kEntries[group.offset + ((raw_instr >> group.shift) & group.mask)];
+    if ((raw_instr & entry.mask) != entry.match) [[unlikely]]
+        return decode_instr<InstrID::kILLEGAL>(raw_instr);
+    return entry.decoder(raw_instr);
 }}"""
 
 
-def generate_one_instr_case(id : str, info : dict) -> str:
+# Expressions computing immediates of each format (see Decoder::ImmFormat)
+IMM_DECODERS : dict[str, str] = {
+    "kI": "decode_i_imm(raw_instr)",
+    "kS": "decode_s_imm(raw_instr)",
+    "kB": "decode_b_imm(raw_instr)",
+    "kU": "decode_u_imm(raw_instr)",
+    "kJ": "decode_j_imm(raw_instr)",
+    "kZeroExtendedI": "get_bits<31, 20>(raw_instr)",
+    "kRaw": "raw_instr",
+}
+
+
+# Expressions placing the immediate w (imm as Word) of each format back into its bits
+IMM_ENCODERS : dict[str, str] = {
+    "kI": "(w & 0xfff) << 20",
+    "kS": "((w & 0x1f) << 7) | ((w & 0xfe0) << 20)",
+    "kB": "((w & 0x1e) << 7) | ((w & 0x800) >> 4) | ((w & 0x7e0) << 20) | ((w & 0x1000) << 19)",
+    "kU": "w & 0xfffff000",
+    "kJ": "(w & 0xff000) | ((w & 0x800) << 9) | ((w & 0x7fe) << 20) | ((w & 0x100000) << 11)",
+    "kZeroExtendedI": "(w & 0xfff) << 20",
+    "kRaw": "w",
+}
+
+
+def immediate_format(id : str, vars : list[str]) -> str:
+    if id == ILLEGAL_INSTRUCTION: # keeps the encoding for the exception
+        return "kRaw"
+    if "csr" in vars: # CSR numbers are unsigned
+        return "kZeroExtendedI"
+    if any(imm_type in vars for imm_type in ["imm12", "shamtd", "shamtw"]):
+        return "kI"
+    if all(imm_type in vars for imm_type in ["imm12hi", "imm12lo"]):
+        return "kS"
+    if all(imm_type in vars for imm_type in ["bimm12hi", "bimm12lo"]):
+        return "kB"
+    if "imm20" in vars:
+        return "kU"
+    if "jimm20" in vars:
+        return "kJ"
+    if all(field in vars for field in ["fm", "pred", "succ"]): # fence instruction
+        return "kZeroExtendedI"
+    return "kNone"
+
+
+def operands(vars : list[str]) -> list[str]:
+    ops : list[str] = []
+    if any(op in vars for op in ["rs1", "zimm"]):
+        ops.append("rs1")
+    if "rs2" in vars:
+        ops.append("rs2")
+    if "rd" in vars:
+        ops.append("rd")
+    return ops
+
+
+def handler_selection(id : str) -> str:
+    """The handler of the instruction: the forms with x0 operands are checked in order"""
+    forms : list[str] = []
+    if id in RD_X0_HANDLERS:
+        forms.append(f"(get_bits<11, 7>(raw_instr) == 0) ? &Hart::exec_{RD_X0_HANDLERS[id]}")
+    if id in RS1_X0_HANDLERS:
+        forms.append(f"(get_bits<19, 15>(raw_instr) == 0) ? &Hart::exec_{RS1_X0_HANDLERS[id]}")
+    return f"\n{" " * 17}: ".join(forms + [f"&Hart::exec_{id}"])
+
+
+def generate_instr_decoder(id : str, info : dict) -> str:
     vars : list[str] = info["variable_fields"]
 
-    out : str = " " * 8  + f"case {info["match"]}:\n" + \
-                " " * 12 + "return [](RawInstruction raw_instr) noexcept {\n" + \
-                " " * 16 + "return Instruction{\n" + \
-                " " * 20 + f".raw = raw_instr,\n" + \
-                " " * 20 + f".id = InstrID::k{id.upper()}"
+    out : str = "template<>\n" + \
+                f"Instruction Decoder::decode_instr<InstrID::k{id.upper()}>" + \
+                "(RawInstruction raw_instr) noexcept\n" + \
+                "{\n" + \
+                " " * 4 + "return Instruction{\n" + \
+                " " * 8 + f".handler = {handler_selection(id)},\n" + \
+                " " * 8 + f".id = InstrID::k{id.upper()}"
 
-    if any(op in vars for op in ["rs1", "zimm"]):
-        out += ",\n" + " " * 20 + ".rs1 = get_bits_r<19, 15, Byte>(raw_instr)"
+    ops : list[str] = operands(vars)
+    if "rs1" in ops:
+        out += ",\n" + " " * 8 + ".rs1 = get_bits_r<19, 15, Byte>(raw_instr)"
 
-    if "rs2" in vars:
-        out += ",\n" + " " * 20 + ".rs2 = get_bits_r<24, 20, Byte>(raw_instr)"
+    if "rs2" in ops:
+        out += ",\n" + " " * 8 + ".rs2 = get_bits_r<24, 20, Byte>(raw_instr)"
 
-    if "rd" in vars:
-        out += ",\n" + " " * 20 + ".rd = get_bits_r<11, 7, Byte>(raw_instr)"
-
-    if "csr" in vars or any(imm_type in vars for imm_type in ["imm12", "shamtd", "shamtw"]):
-        out += ",\n" + " " * 20 + ".imm = decode_i_imm(raw_instr)"
-    elif all(imm_type in vars for imm_type in ["imm12hi", "imm12lo"]):
-        out += ",\n" + " " * 20 + ".imm = decode_s_imm(raw_instr)"
-    elif all(imm_type in vars for imm_type in ["bimm12hi", "bimm12lo"]):
-        out += ",\n" + " " * 20 + ".imm = decode_b_imm(raw_instr)"
-    elif "imm20" in vars:
-        out += ",\n" + " " * 20 + ".imm = decode_u_imm(raw_instr)"
-    elif "jimm20" in vars:
-        out += ",\n" + " " * 20 + ".imm = decode_j_imm(raw_instr)"
-    elif all(field in vars for field in ["fm", "pred", "succ"]): # fence instruction
-        out += ",\n" + " " * 20 + ".imm = get_bits<31, 20>(raw_instr)"
-
-    out += "\n" + " " * 16 + "};\n" + " " * 12 + "};"
+    if "rd" in ops:
+        out += ",\n" + " " * 8 + ".rd = get_bits_r<11, 7, Byte>(raw_instr)"
+
+    if (imm_format := immediate_format(id, vars)) != "kNone":
+        out += ",\n" + " " * 8 + \
+               f".imm = static_cast<Instruction::immediate_type>({IMM_DECODERS[imm_format]})"
+
+    out += "\n" + " " * 4 + "};\n" + "}"
 
     return out
 
 
-def generate_instr_switch(data : dict[str, dict]) -> str:
+def generate_formats(data : dict[str, dict]) -> str:
+    infos : dict[str, dict] = dict(data, **{ILLEGAL_INSTRUCTION: {"variable_fields": []}})
 
-    cases : list[str] = [generate_one_instr_case(id, info) for id, info in data.items()]
+    lines : list[str] = []
+    for id, info in infos.items():
+        vars : list[str] = info["variable_fields"]
+        ops : str = " | ".join(f"k{op.upper()}" for op in operands(vars)) or "0"
+        imm : str = immediate_format(id, vars)
+        handlers : str = ", ".join(f"&Hart::exec_{handler}" for handler in [
+            id, RD_X0_HANDLERS.get(id, id), RS1_X0_HANDLERS.get(id, id)])
+        lines.append(" " * 4 + f"{{{{{handlers}}}, {ops}, ImmFormat::{imm}}}")
 
-    return f"""Decoder::decoding_func_type Decoder::get_decoder(match_type match) noexcept
-{{
-    switch (match)
-    {{
-{"\n".join(cases)}
-        default: [[unlikely]]
-            return nullptr;
-    }}
-}}"""
+    return f"""const std::array<Decoder::Format, kFirstFusedID> Decoder::kFormats = {{{{
+{",\n".join(lines)}
+}}}};"""
 
 
 def generate_decoder(data : dict[str, dict], output_path : str) -> None:
+    decoders : list[str] = [generate_instr_decoder(id, info) for id, info in data.items()]
+    decoders.append(generate_instr_decoder(ILLEGAL_INSTRUCTION, {"variable_fields": []}))
+
     content : str = f"""/*
  * This file is automatically generated. Do not change it
  */
 
-#include <stdexcept>
-
-#include <fmt/format.h>
+#include <array>
 
 #include "yarvs/bits_manipulation.hpp"
+#include "yarvs/common.hpp"
 #include "yarvs/decoder.hpp"
+#include "yarvs/hart.hpp"
 #include "yarvs/identifiers.hpp"
 
 namespace yarvs
 {{
 
+{"\n\n".join(decoders)}
+
 {generate_decoding_method(data)}
 
-{generate_instr_switch(data)}
+{generate_formats(data)}
 
 }} // namespace yarvs
 """
@@ -190,22 +345,15 @@ namespace yarvs
 
 
 def generate_executor_declarations(data: dict[str, dict]) -> str:
+    ids : list[str] = list(data.keys()) + [ILLEGAL_INSTRUCTION] + \
+                      list(FUSED_INSTRUCTIONS.keys()) + SPECIALIZED_HANDLERS
     decl_list = [" " * 4 + \
-                 f"static bool exec_{id}(Hart &h, const Instruction &instr);" for id in data.keys()]
+                 f"static bool exec_{id}(Hart &h, const Instruction &instr);" for id in ids]
     return "\n".join(decl_list)
 
 
-def generate_exec_table(data : dict[str, dict]) -> str:
-    decl_list = [" " * 8 + f"exec_{id}" for id in data.keys()]
-    return ",\n".join(decl_list)
-
-
 def generate_executor_header(data : dict[str, dict], output_path : str) -> None:
     content : str = f"""{generate_executor_declarations(data)}
-
-    static constexpr std::array<callback_type, InstrID::kEndID> kCallbacks_ = {{
-{generate_exec_table(data)}
-    }};
 """
 
     with open(output_path, "w") as executor_file:
@@ -269,13 +417,43 @@ def generate_one_instr_dump(id : str, info : dict) -> str:
         out += "return \"sfence.vma\";\n"
         return out
 
+    if id == "fence_i":
+        out += "return \"fence.i\";\n"
+        return out
+
     out += "return \"<disassembly unsupported>\";\n"
     return out
 
 
+def generate_instr_encoder(id : str, info : dict) -> str:
+    vars : list[str] = info["variable_fields"]
+    match : str = info.get("match", "0x0")
+
+    terms : list[str] = [match]
+    ops : list[str] = operands(vars)
+    if "rs1" in ops:
+        terms.append("(Word{rs1} << 15)")
+    if "rs2" in ops:
+        terms.append("(Word{rs2} << 20)")
+    if "rd" in ops:
+        terms.append("(Word{rd} << 7)")
+    if (imm_format := immediate_format(id, vars)) != "kNone":
+        terms.append(f"({IMM_ENCODERS[imm_format]})")
+
+    return " " * 8 + f"case InstrID::k{id.upper()}:\n" + \
+           " " * 12 + f"return {" | ".join(terms)};"
+
+
 def generate_instruction_dump(data : dict[str, dict], output_path : str) -> None:
 
     cases : list[str] = [generate_one_instr_dump(id, info) for id, info in data.items()]
+    cases.append(" " * 8 + f"case InstrID::k{ILLEGAL_INSTRUCTION.upper()}:\n" + " " * 12 +
+                 "return fmt::format(\"<illegal instruction {:#010x}>\", Word(imm));\n")
+    cases += [" " * 8 + f"case InstrID::k{id.upper()}:\n" + " " * 12 + f"return {dump};\n"
+              for id, dump in FUSED_INSTRUCTIONS.items()]
+
+    encoders : list[str] = [generate_instr_encoder(id, info) for id, info in data.items()]
+    encoders.append(generate_instr_encoder(ILLEGAL_INSTRUCTION, {"variable_fields": []}))
 
     content : str = f"""/*
  * This file is automatically generated. Do not change it
@@ -297,6 +475,7 @@ namespace yarvs
 std::string Instruction::disassemble() const
 {{
     using enum CSRegFile::CSR;
+    const DoubleWord imm = Instruction::imm; // as executors see it
     switch (id)
     {{
 {"\n".join(cases)}
@@ -305,6 +484,17 @@ std::string Instruction::disassemble() const
     }}
 }}
 
+RawInstruction Instruction::encode() const noexcept
+{{
+    const auto w = static_cast<Word>(imm);
+    switch (id)
+    {{
+{"\n".join(encoders)}
+        default: // fused pseudo-instructions
+            return 0;
+    }}
+}}
+
 }} // namespace yarvs
 """
 
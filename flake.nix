@@ -21,6 +21,7 @@
                 elfio
                 cli11
                 gtest
+                gbenchmark
             ];
             nativeBuildInputs = with pkgs; [
                 cmake
@@ -0,0 +1,70 @@
+#ifndef INCLUDE_CACHE_ARENA_HPP
+#define INCLUDE_CACHE_ARENA_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+
+namespace yarvs
+{
+
+/*
+ * Bump allocator: objects are placed one after another in a single buffer and are only freed all
+ * at once by clear(). Allocation is an increment of an offset, and objects allocated one after
+ * another stay close in memory.
+ */
+class Arena final
+{
+public:
+
+    using size_type = std::size_t;
+
+    explicit Arena(size_type capacity)
+        : buffer_{std::make_unique_for_overwrite<std::byte[]>(capacity)}, capacity_{capacity}
+    {}
+
+    size_type capacity() const noexcept { return capacity_; }
+    size_type size() const noexcept { return size_; }
+    size_type available() const noexcept { return capacity_ - size_; }
+
+    // the number of bytes n objects of type T may take, alignment included
+    template<typename T>
+    static constexpr size_type footprint(size_type n) noexcept
+    {
+        return n * sizeof(T) + alignof(T) - 1;
+    }
+
+    /*
+     * Copies objects to the arena. Returns an empty span if there's not enough space for them:
+     * footprint<T>(objects.size()) bytes available are always enough.
+     */
+    template<typename T>
+    requires std::is_trivially_copyable_v<T> && (alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+    std::span<const T> copy(std::span<const T> objects) noexcept
+    {
+        const auto begin = (size_ + alignof(T) - 1) / alignof(T) * alignof(T);
+        if (objects.empty() || begin > capacity_ || capacity_ - begin < objects.size_bytes())
+            return {};
+
+        // copying of trivially copyable objects to the buffer starts their lifetime
+        auto *dst = buffer_.get() + begin;
+        std::memcpy(dst, objects.data(), objects.size_bytes());
+        size_ = begin + objects.size_bytes();
+        return {std::launder(reinterpret_cast<const T *>(dst)), objects.size()};
+    }
+
+    void clear() noexcept { size_ = 0; }
+
+private:
+
+    std::unique_ptr<std::byte[]> buffer_;
+    size_type capacity_;
+    size_type size_ = 0;
+};
+
+} // namespace yarvs
+
+#endif // INCLUDE_CACHE_ARENA_HPP
@@ -0,0 +1,128 @@
+#ifndef INCLUDE_CACHE_DIRECT_MAPPED_HPP
+#define INCLUDE_CACHE_DIRECT_MAPPED_HPP
+
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace yarvs
+{
+
+/*
+ * Direct-mapped cache: a key may only reside in the line with index (key >> kOffsetBits) modulo
+ * capacity. Thus lookup is a single comparison, and eviction is just overwriting of the line.
+ * kOffsetBits allows to ignore the low bits of keys that are known to be always zero (e.g. due to
+ * alignment) so that they do not waste lines.
+ */
+template<std::unsigned_integral KeyT, typename PageT, std::size_t kOffsetBits = 0>
+class DirectMapped final
+{
+public:
+
+    using key_type = KeyT;
+    using page_type = PageT;
+    using size_type = std::size_t;
+    using counter_type = std::uintmax_t;
+
+    explicit DirectMapped(size_type capacity) : lines_(capacity)
+    {
+        if (!std::has_single_bit(capacity))
+            throw std::invalid_argument{"capacity of a direct-mapped cache shall be a power of 2"};
+    }
+
+    size_type capacity() const noexcept { return lines_.size(); }
+
+    // returns nullptr on miss
+    page_type *lookup(const key_type &key) noexcept
+    {
+        auto &line = lines_[index(key)];
+        if (line.valid && line.key == key) [[likely]]
+        {
+            ++hits_;
+            return &line.page;
+        }
+        ++misses_;
+        return nullptr;
+    }
+
+    // like lookup, but doesn't count hits and misses
+    const page_type *find(const key_type &key) const noexcept
+    {
+        const auto &line = lines_[index(key)];
+        return (line.valid && line.key == key) ? &line.page : nullptr;
+    }
+
+    // pages are stored in place: a pointer to a page stays valid until the cache is destroyed
+    page_type &update(const key_type &key, const page_type &page) { return update_impl(key, page); }
+    page_type &update(const key_type &key, page_type &&page)
+    {
+        return update_impl(key, std::move(page));
+    }
+
+    void clear()
+    {
+        for (auto &line : lines_)
+        {
+            line.valid = false;
+            line.page = page_type{};
+        }
+    }
+
+    // invalidates the lines whose pages satisfy pred
+    template<std::predicate<const page_type &> Pred>
+    void erase_if(Pred pred)
+    {
+        for (auto &line : lines_)
+            if (line.valid && pred(std::as_const(line.page)))
+            {
+                line.valid = false;
+                line.page = page_type{};
+            }
+    }
+
+    counter_type hits() const noexcept { return hits_; }
+    counter_type misses() const noexcept { return misses_; }
+    counter_type evictions() const noexcept { return evictions_; }
+
+private:
+
+    size_type index(const key_type &key) const noexcept
+    {
+        return (key >> kOffsetBits) & (capacity() - 1);
+    }
+
+    template<typename P>
+    page_type &update_impl(const key_type &key, P &&page)
+    {
+        auto &line = lines_[index(key)];
+        if (line.valid && line.key != key)
+            ++evictions_;
+
+        line.key = key;
+        line.page = std::forward<P>(page);
+        line.valid = true;
+
+        return line.page;
+    }
+
+    struct Line final
+    {
+        key_type key{};
+        bool valid = false;
+        page_type page{};
+    };
+
+    std::vector<Line> lines_;
+
+    counter_type hits_ = 0;
+    counter_type misses_ = 0;
+    counter_type evictions_ = 0;
+};
+
+} // namespace yarvs
+
+#endif // INCLUDE_CACHE_DIRECT_MAPPED_HPP
@@ -24,6 +24,12 @@ using RawInstruction = std::uint32_t;
 constexpr auto kXLen = sizeof(DoubleWord) * CHAR_BIT;
 constexpr std::size_t kOpcodeBitLen = 7;
 
+// std::hardware_destructive_interference_size is not a stable ABI constant
+constexpr std::size_t kCacheLineSize = 64;
+
+// pages are 4KB; headers that memory.hpp includes can't refer to Memory::kPageBits
+constexpr DoubleWord kPageBits = 12;
+
 enum PrivilegeLevel : Byte
 {
     kUser = 0,
@@ -32,6 +38,16 @@ enum PrivilegeLevel : Byte
     kMachine = 3
 };
 
+/*
+ * The user ISA profile (YARVS_ISA_PROFILE=user) has neither CSR instructions nor xRET, so guest
+ * code always runs in U-mode and can't change the privilege level or the translation context.
+ */
+#ifdef YARVS_USER_ISA
+inline constexpr bool kUserISA = true;
+#else
+inline constexpr bool kUserISA = false;
+#endif
+
 } // namespace yarvs
 
 #endif // INCLUDE_COMMON_HPP
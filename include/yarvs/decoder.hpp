@@ -1,9 +1,16 @@
 #ifndef INCLUDE_DECODER_HPP
 #define INCLUDE_DECODER_HPP
 
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <span>
+
 #include "yarvs/bits_manipulation.hpp"
 #include "yarvs/common.hpp"
+#include "yarvs/identifiers.hpp" // generated header
 #include "yarvs/instruction.hpp"
+#include "yarvs/instruction_buffer.hpp"
 
 namespace yarvs
 {
@@ -18,12 +25,39 @@ public:
 
     explicit Decoder() = default;
 
-    static Instruction decode(RawInstruction raw_instr); // generated from risc-v opcodes
+    /*
+     * Generated from risc-v opcodes. Encodings that are not valid instructions are decoded as
+     * kILLEGAL, whose executor raises the illegal instruction exception.
+     */
+    static Instruction decode(RawInstruction raw_instr) noexcept;
 
-private:
+    /*
+     * Decodes raw_instrs into buffer exactly as decode does one by one. On x86-64 hosts supporting
+     * AVX2 groups of 8 instructions are looked up and split into fields at a time.
+     */
+    static void decode_bulk(std::span<const RawInstruction> raw_instrs, InstructionBuffer &buffer);
 
-    // generated from risc-v opcodes
-    static decoding_func_type get_decoder(match_type match) noexcept;
+    /*
+     * Fuses a pair of consecutive instructions into one pseudo-instruction if it's a known idiom:
+     * constant materialization, far call or load, zero extension or compare and branch. Only the
+     * second instruction of such a pair may raise an exception.
+     */
+    static std::optional<Instruction> fuse(const Instruction &first,
+                                           const Instruction &second) noexcept;
+
+    /*
+     * auipc+jalr and auipc+ld keep both immediates in imm: the one of the second instruction is
+     * placed in the low 12 bits, which are 0 in the immediate of auipc.
+     */
+    static constexpr DoubleWord fused_auipc_imm(const Instruction &instr) noexcept
+    {
+        return sext<32, DoubleWord>(mask_bits<31, 12>(static_cast<Word>(instr.imm)));
+    }
+
+    static constexpr DoubleWord fused_offset_imm(const Instruction &instr) noexcept
+    {
+        return sext<12, DoubleWord>(mask_bits<11, 0>(static_cast<Word>(instr.imm)));
+    }
 
     static constexpr DoubleWord decode_i_imm(RawInstruction raw_instr) noexcept
     {
@@ -56,6 +90,78 @@ private:
                                   | (mask_bits<19, 12>(raw_instr))
                                   | (mask_bit<31>(raw_instr) >> 11));
     }
+
+private:
+
+    // generated from risc-v opcodes: fills in the fields of instruction kID
+    template<InstrID kID>
+    static Instruction decode_instr(RawInstruction raw_instr) noexcept;
+
+    // the decoding tables are described in decode
+    static constexpr std::size_t kNGroups = 256;
+
+    struct Group final
+    {
+        HalfWord offset;
+        HalfWord mask;
+        Byte shift;
+    };
+
+    struct Entry final
+    {
+        mask_type mask;
+        match_type match;
+        decoding_func_type decoder;
+        InstrID id;
+    };
+
+    // the fields and the immediate encoding of every instruction for decode_bulk
+    enum Operand : Byte
+    {
+        kRS1 = 1 << 0,
+        kRS2 = 1 << 1,
+        kRD = 1 << 2
+    };
+
+    enum class ImmFormat : Byte
+    {
+        kNone,
+        kI,
+        kS,
+        kB,
+        kU,
+        kJ,
+        kZeroExtendedI, // bits 31:20 zero-extended: CSR numbers and fence fields
+        kRaw // the whole encoding (kILLEGAL)
+    };
+
+    // operand forms having handlers of their own; rd == x0 takes precedence over rs1 == x0
+    enum Form : Byte
+    {
+        kGeneral,
+        kRDX0,
+        kRS1X0,
+        kNForms
+    };
+
+    struct Format final
+    {
+        std::array<Instruction::handler_type, kNForms> handlers; // the general one if not special
+        Byte operands;
+        ImmFormat imm;
+    };
+
+    /*
+     * Decodes the longest prefix of raw_instrs whose length is a multiple of 8 into buffer starting
+     * at index first. Returns the length of the prefix. Defined on x86-64 hosts only.
+     */
+    static std::size_t decode_bulk_avx2(std::span<const RawInstruction> raw_instrs,
+                                        InstructionBuffer &buffer, std::size_t first) noexcept;
+
+    // generated from risc-v opcodes
+    static const std::array<Group, kNGroups> kGroups;
+    static const Entry kEntries[];
+    static const std::array<Format, kFirstFusedID> kFormats;
 };
 
 } // namespace yarvs
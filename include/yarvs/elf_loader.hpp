@@ -34,6 +34,7 @@ public:
         DoubleWord memory_size;
         DoubleWord file_size;
         DoubleWord virtual_address;
+        SegmentFlags flags;
         bool loadable;
     };
 
@@ -1,7 +1,9 @@
 #ifndef INCLUDE_HART_HPP
 #define INCLUDE_HART_HPP
 
+#include <algorithm>
 #include <array>
+#include <bit>
 #include <concepts>
 #include <cstddef>
 #include <cstdint>
@@ -9,15 +11,21 @@
 #include <expected>
 #include <functional>
 #include <memory>
+#include <optional>
+#include <span>
 #include <string_view>
 #include <type_traits>
 #include <vector>
 
 #include "yarvs/common.hpp"
 #include "yarvs/instruction.hpp"
+#include "yarvs/predecoded_code.hpp"
 #include "yarvs/reg_file.hpp"
 
-#include "yarvs/cache/lru.hpp"
+#include "yarvs/cache/arena.hpp"
+#include "yarvs/cache/direct_mapped.hpp"
+
+#include "yarvs/jit/jit.hpp"
 
 #include "yarvs/memory/memory.hpp"
 
@@ -26,13 +34,34 @@
 #include "yarvs/privileged/machine/mcause.hpp"
 #include "yarvs/privileged/machine/mstatus.hpp"
 
+#include "yarvs/privileged/supervisor/satp.hpp"
 #include "yarvs/privileged/supervisor/scause.hpp"
 #include "yarvs/privileged/supervisor/sstatus.hpp"
 
+/*
+ * In the tail-call mode executors of instructions of a cached basic block jump to each other
+ * directly. Such calls are guaranteed not to grow the stack only with a musttail attribute: clang
+ * has one, GCC has one since version 15. Other compilers would have to perform sibling call
+ * optimization on their own, which unoptimized builds don't do, so the mode is off with them.
+ */
+#if defined(YARVS_TAIL_CALLS) && defined(__has_cpp_attribute)
+#if __has_cpp_attribute(clang::musttail)
+#define YARVS_MUSTTAIL [[clang::musttail]]
+#elif __has_cpp_attribute(gnu::musttail)
+#define YARVS_MUSTTAIL [[gnu::musttail]]
+#endif
+#endif
+
+#ifdef YARVS_MUSTTAIL
+#define YARVS_TAIL_CALL_THREADING
+#else
+#define YARVS_MUSTTAIL
+#endif
+
 namespace yarvs
 {
 
-class Hart final
+class alignas(kCacheLineSize) Hart final
 {
 public:
 
@@ -41,7 +70,33 @@ public:
     static constexpr std::array<std::size_t, 6> kSyscallArgRegs = {10, 11, 12, 13, 14, 15};
     static constexpr std::size_t kSyscallNumReg = 17;
 
-    explicit Hart();
+    static constexpr std::size_t kDefaultCacheCapacity = 4096;
+
+    // the user ISA profile stops on an exception with this status plus the exception code
+    static constexpr int kExceptionStatusBase = 100;
+
+    enum Tier : std::size_t
+    {
+        kInterpreted, // fetched and decoded on every execution
+        kDecoded,     // decoded instructions are cached
+        kNative       // translated by the JIT
+    };
+
+    static constexpr std::size_t kNTiers = 3;
+
+    /*
+     * A block is promoted to the next tier on reaching the given number of executions in the
+     * current one. Cold code executed only once, such as startup code, is never cached.
+     */
+    struct TierThresholds final
+    {
+        std::uint32_t decoded = 2;
+        std::uint32_t native = 16;
+    };
+
+    // bb_cache_capacity shall be a power of 2
+    explicit Hart(std::size_t bb_cache_capacity = kDefaultCacheCapacity,
+                  const MemoryOptions &mem_options = {});
 
     // returns the number of executed instructions
     std::uintmax_t run();
@@ -69,11 +124,53 @@ public:
 
     PrivilegeLevel get_privilege_level() const noexcept { return priv_level_; }
 
+    std::size_t bb_cache_capacity() const noexcept { return bb_cache_.capacity(); }
+    std::uintmax_t bb_cache_hits() const noexcept { return bb_cache_.hits(); }
+    std::uintmax_t bb_cache_misses() const noexcept { return bb_cache_.misses(); }
+    std::uintmax_t bb_cache_evictions() const noexcept { return bb_cache_.evictions(); }
+    std::uintmax_t bb_cache_flushes() const noexcept { return bb_cache_flushes_; }
+    std::uintmax_t bb_chain_hits() const noexcept { return bb_chain_hits_; }
+
+    /*
+     * Instructions of the block cached at pc as they are executed: fused pairs included, and
+     * segments terminated with kBlockEnd in the tail-call mode. Empty if no block is cached there.
+     */
+    std::span<const Instruction> cached_block(DoubleWord pc) const noexcept
+    {
+        const auto *bb = bb_cache_.find(pc);
+        return bb ? bb->instrs : std::span<const Instruction>{};
+    }
+
+    const TierThresholds &get_tier_thresholds() const noexcept { return tier_thresholds_; }
+    // throws std::invalid_argument if any threshold is 0
+    void set_tier_thresholds(const TierThresholds &thresholds);
+
+    // the number of block executions in the given tier
+    std::uintmax_t tier_executions(Tier tier) const noexcept { return tier_executions_[tier]; }
+
+    /*
+     * Enables translation of hot basic blocks into native code. Throws std::runtime_error if the
+     * host architecture is not supported by the JIT. The buffer size is used if the JIT is created.
+     */
+    void set_jit(bool jit, std::size_t code_buffer_size = JIT::kDefaultCodeBufferSize);
+    const JIT *jit() const noexcept { return jit_.get(); }
+
+    /*
+     * Decodes the executable segment [va, va + code.size()) loaded at physical address pa in
+     * advance. Fetches are still translated in every mode, Bare included, and use the predecoded
+     * instructions when they reach the segment: they are found by physical address, so they stay
+     * valid across SFENCE.VMA. Stores to the segment and FENCE.I invalidate them.
+     */
+    void predecode(DoubleWord va, DoubleWord pa, std::span<const Byte> code);
+    // finds basic blocks of the predecoded segments reachable from entry
+    void recover_cfg(DoubleWord entry) { predecoded_code_.recover_cfg(entry); }
+    const PredecodedCode &predecoded_code() const noexcept { return predecoded_code_; }
+
 private:
 
     void raise_exception(DoubleWord cause, DoubleWord info) noexcept
     {
-        if (eh_mode(cause) == PrivilegeLevel::kMachine)
+        if (kUserISA || eh_mode(cause) == PrivilegeLevel::kMachine)
         {
             csrs_.set_mepc(pc_);
             csrs_.set_mtval(info);
@@ -87,7 +184,15 @@ private:
             csrs_.set_mstatus(mstatus);
 
             priv_level_ = PrivilegeLevel::kMachine;
-            pc_ = csrs_.get_mtvec().get_base();
+
+            // no trap handler could return without CSR instructions and mret
+            if constexpr (kUserISA)
+            {
+                status_ = kExceptionStatusBase + static_cast<int>(cause);
+                run_ = false;
+            }
+            else
+                pc_ = csrs_.get_mtvec().get_base();
         }
         else
         {
@@ -105,6 +210,8 @@ private:
             priv_level_ = PrivilegeLevel::kSupervisor;
             pc_ = csrs_.get_stvec().get_base();
         }
+
+        mem_.flush_tlb();
     }
 
     PrivilegeLevel eh_mode(DoubleWord cause) const noexcept
@@ -116,6 +223,33 @@ private:
         return PrivilegeLevel::kMachine;
     }
 
+#ifndef YARVS_USER_ISA
+    void set_csr(std::size_t i, DoubleWord value) noexcept
+    {
+        if (i == CSRegFile::kSATP)
+        {
+            /*
+             * Translations are tagged with ASID, so switching between address spaces keeps TLBs
+             * intact. Software shall execute SFENCE.VMA if it modifies the address space in place.
+             * Changes of MODE, however, take effect immediately.
+             */
+            const bool mode_changed = csrs_.get_satp().get_mode() != SATP{value}.get_mode();
+            csrs_.set_reg(i, value);
+            if (mode_changed)
+                mem_.flush_tlb();
+            else
+                mem_.select_access_path(); // for the new ASID
+            return;
+        }
+
+        csrs_.set_reg(i, value);
+
+        // these registers define the translation context cached in TLBs
+        if (i == CSRegFile::kMStatus || i == CSRegFile::kSStatus)
+            mem_.flush_tlb();
+    }
+#endif // YARVS_USER_ISA
+
     /*
      * Pointer to static method is used instead of pointer to non-static method, because:
      * 1) the size of a pointer to static method is usually less than the size of a pointer to a
@@ -123,11 +257,72 @@ private:
      * 2) calling through pointer to non-static method involved run-time checking on whether this
      *    pointer points to a virtual function.
      */
-    using callback_type = bool(*)(Hart &, const Instruction &);
+    using callback_type = Instruction::handler_type;
+
+    friend class Decoder; // resolves callbacks of decoded instructions
 
     #include "yarvs/executor_declarations.hpp" // generated header
 
-    bool execute(const Instruction &instr);
+#ifdef YARVS_TAIL_CALL_THREADING
+    static constexpr bool kTailCalls = true;
+#else
+    static constexpr bool kTailCalls = false;
+#endif
+
+    /*
+     * Every executor finishes with a call to this function after the instruction has been
+     * executed successfully. In the tail-call mode it proceeds to the next instruction of the
+     * block, so the whole block is executed without returning to Hart::run. Cached blocks are
+     * terminated with kBlockEnd whose executor returns to Hart::run.
+     */
+    static bool dispatch_next(Hart &h, const Instruction &instr)
+    {
+        if constexpr (kTailCalls)
+        {
+            const Instruction &next = *(&instr + 1);
+            YARVS_MUSTTAIL return next.handler(h, next);
+        }
+        else
+            return true;
+    }
+
+    static bool exec_block_end(Hart &, const Instruction &) { return true; }
+
+    static constexpr Instruction kBlockEnd{.handler = &exec_block_end};
+
+    // executes instr alone even if it's followed by other instructions of a block
+    bool execute_single(const Instruction &instr)
+    {
+        if constexpr (kTailCalls)
+        {
+            const std::array<Instruction, 2> single = {instr, kBlockEnd};
+            return single.front().handler(*this, single.front());
+        }
+        else
+            return instr.handler(*this, instr);
+    }
+
+    // logs the instruction and the registers it changes
+    bool execute_logged(const Instruction &instr);
+
+    template<bool kLogging>
+    bool execute(const Instruction &instr)
+    {
+        if constexpr (kLogging)
+            return execute_logged(instr);
+        else
+            return execute_single(instr);
+    }
+
+    /*
+     * The main loop of run(). It's instantiated for each mode once, so that the mode is checked
+     * when run() starts instead of on every instruction.
+     */
+    template<bool kLogging>
+    std::uintmax_t run_loop();
+
+    // translated code calls it to execute instructions that the JIT doesn't compile
+    static bool jit_fallback(Hart &h, const Instruction &instr) { return h.execute_single(instr); }
 
     template<std::regular_invocable<DoubleWord, DoubleWord> F>
     void exec_rvi_reg_reg(const Instruction &instr, F bin_op)
@@ -141,7 +336,7 @@ private:
     void exec_rvi_reg_imm(const Instruction &instr, F bin_op)
     noexcept(std::is_nothrow_invocable_v<F, DoubleWord, DoubleWord>)
     {
-        gprs_.set_reg(instr.rd, bin_op(gprs_.get_reg(instr.rs1), instr.imm));
+        gprs_.set_reg(instr.rd, bin_op(gprs_.get_reg(instr.rs1), DoubleWord(instr.imm)));
         pc_ += sizeof(RawInstruction);
     }
 
@@ -158,7 +353,7 @@ private:
     void exec_rv64i_reg_imm(const Instruction &instr, F bin_op)
     noexcept(std::is_nothrow_invocable_v<F, DoubleWord, DoubleWord>)
     {
-        auto res = bin_op(gprs_.get_reg(instr.rs1), instr.imm);
+        auto res = bin_op(gprs_.get_reg(instr.rs1), DoubleWord(instr.imm));
         gprs_.set_reg(instr.rd, sext<32, DoubleWord>(static_cast<Word>(res)));
         pc_ += sizeof(RawInstruction);
     }
@@ -173,6 +368,19 @@ private:
             pc_ += sizeof(RawInstruction);
     }
 
+    // fused compare and branch: rd = rs1 < rs2, then branch on whether rd is set
+    template<std::predicate<DoubleWord, DoubleWord> F>
+    void exec_fused_set_branch(const Instruction &instr, F less, bool taken_if_set)
+    noexcept(std::is_nothrow_invocable_v<F, DoubleWord, DoubleWord>)
+    {
+        const bool set = less(gprs_.get_reg(instr.rs1), gprs_.get_reg(instr.rs2));
+        gprs_.set_reg(instr.rd, set);
+        if (set == taken_if_set)
+            pc_ += instr.imm;
+        else
+            pc_ += 2 * sizeof(RawInstruction);
+    }
+
     template<riscv_type T>
     bool exec_load(const Instruction &instr)
     {
@@ -218,6 +426,7 @@ private:
         return true;
     }
 
+#ifndef YARVS_USER_ISA
     template<typename F>
     bool exec_csrrw_csrrwi(const Instruction &instr, F rhs)
     {
@@ -225,16 +434,16 @@ private:
             CSRegFile::is_for_debug_mode(instr.imm) ||
             CSRegFile::is_read_only(instr.imm)) [[unlikely]]
         {
-            raise_exception(MCause::kIllegalInstruction, instr.raw);
+            raise_exception(MCause::kIllegalInstruction, instr.encode());
             return false;
         }
 
         if (instr.rd == 0)
-            csrs_.set_reg(instr.imm, std::invoke(rhs, instr));
+            set_csr(instr.imm, std::invoke(rhs, instr));
         else
         {
             auto csr = csrs_.get_reg(instr.imm);
-            csrs_.set_reg(instr.imm, std::invoke(rhs, instr));
+            set_csr(instr.imm, std::invoke(rhs, instr));
             gprs_.set_reg(instr.rd, csr);
         }
 
@@ -248,7 +457,7 @@ private:
         if (priv_level_ < CSRegFile::get_lowest_privilege_level(instr.imm) ||
             CSRegFile::is_for_debug_mode(instr.imm)) [[unlikely]]
         {
-            raise_exception(MCause::kIllegalInstruction, instr.raw);
+            raise_exception(MCause::kIllegalInstruction, instr.encode());
             return false;
         }
 
@@ -258,34 +467,194 @@ private:
         {
             if (CSRegFile::is_read_only(instr.imm)) [[unlikely]]
             {
-                raise_exception(MCause::kIllegalInstruction, instr.raw);
+                raise_exception(MCause::kIllegalInstruction, instr.encode());
                 return false;
             }
 
             const auto csr = csrs_.get_reg(instr.imm);
-            csrs_.set_reg(instr.imm, bin_op(csr, std::invoke(rhs, instr)));
+            set_csr(instr.imm, bin_op(csr, std::invoke(rhs, instr)));
             gprs_.set_reg(instr.rd, csr);
         }
 
         pc_ += sizeof(RawInstruction);
         return true;
     }
+#endif // YARVS_USER_ISA
 
-    PrivilegeLevel priv_level_;
-
+    // the state every instruction touches comes first and shares the first cache lines
     RegFile gprs_;
     DoubleWord pc_;
-    CSRegFile csrs_;
+    PrivilegeLevel priv_level_;
+    bool run_ = false;
+    int status_ = 0;
 
+    CSRegFile csrs_; // read by the constructor of mem_
     Memory mem_;
 
-    static constexpr std::size_t kDefaultCacheCapacity = 64;
     static constexpr std::size_t kDefaultBBLength = 24;
-    using BasicBlock = std::vector<Instruction>;
-    LRU<DoubleWord, BasicBlock> bb_cache_;
+    static constexpr std::size_t kMaxTraceLength = 64;
 
-    int status_ = 0;
-    bool run_ = false;
+    /*
+     * A superblock: a trace of basic blocks along the path that execution took when the block
+     * was built. Every basic block but the last ends with a direct jump. The trace only goes on
+     * past a conditional branch in the direction the branch has mostly taken in cold code. If a
+     * branch goes the other way on later executions, the trace is left through a side exit: the
+     * branch has already set pc_ to its actual target, so execution just stops there.
+     */
+    struct BasicBlock final
+    {
+        // instructions are 4-byte aligned, so this value never matches pc of a real block
+        static constexpr DoubleWord kInvalidPC = 1;
+
+        // instructions at consecutive addresses
+        struct Segment final
+        {
+            DoubleWord pc;
+            std::size_t begin; // index of the first instruction in instrs
+            std::size_t size;
+            std::size_t length; // the number of RISC-V instructions: fused pairs count twice
+        };
+
+        DoubleWord pc = kInvalidPC;
+        // segments are terminated with kBlockEnd in the tail-call mode; all the parts of a block
+        // are stored in bb_arena_
+        std::span<const Instruction> instrs;
+        std::span<const Segment> segments;
+        std::span<const DoubleWord> pages; // physical pages the instructions were fetched from
+
+        /*
+         * Links to successors of a block ending with a direct jump. They are patched lazily when
+         * the successor is executed for the first time. Blocks are stored in place in the cache,
+         * so a successor that has been evicted is overwritten by a block with another pc. That is
+         * why a link is only followed if the block it points to still starts at the expected pc.
+         */
+        BasicBlock *taken = nullptr;
+        BasicBlock *fall_through = nullptr;
+
+        JIT::entry_type native = nullptr; // translated code of the block
+        std::uint32_t n_executions = 0; // counted only if the block is to be translated
+
+        std::span<const Instruction> body(const Segment &segment) const noexcept
+        {
+            return instrs.subspan(segment.begin, segment.size);
+        }
+
+        DoubleWord fall_through_pc() const noexcept
+        {
+            return segments.back().pc + segments.back().length * sizeof(RawInstruction);
+        }
+
+        BasicBlock *successor(DoubleWord next_pc) const noexcept
+        {
+            auto *succ = (next_pc == fall_through_pc()) ? fall_through : taken;
+            return (succ && succ->pc == next_pc) ? succ : nullptr;
+        }
+
+        DoubleWord taken_pc() const noexcept
+        {
+            const auto &last = body(segments.back()).back();
+            return fall_through_pc() - last.length() * sizeof(RawInstruction) + last.imm;
+        }
+
+        // a block entered from a side exit is not a successor: it doesn't replace the links
+        void link(BasicBlock &succ) noexcept
+        {
+            if (!body(segments.back()).back().is_direct_jump())
+                return;
+            if (succ.pc == fall_through_pc())
+                fall_through = &succ;
+            else if (succ.pc == taken_pc())
+                taken = &succ;
+        }
+    };
+
+    // a block being built: it's copied to bb_arena_ once complete
+    struct BlockBuilder final
+    {
+        std::vector<Instruction> instrs;
+        std::vector<BasicBlock::Segment> segments;
+        std::vector<DoubleWord> pages;
+
+        void clear() noexcept
+        {
+            instrs.clear();
+            segments.clear();
+            pages.clear();
+        }
+
+        bool contains(DoubleWord addr) const noexcept
+        {
+            return std::ranges::any_of(segments, [addr](const BasicBlock::Segment &segment)
+            {
+                return segment.pc <= addr &&
+                       addr < segment.pc + segment.length * sizeof(RawInstruction);
+            });
+        }
+
+        std::size_t footprint() const noexcept
+        {
+            return Arena::footprint<Instruction>(instrs.size()) +
+                   Arena::footprint<BasicBlock::Segment>(segments.size()) +
+                   Arena::footprint<DoubleWord>(pages.size());
+        }
+    };
+
+    /*
+     * Copies the block to bb_arena_ and caches it. Space of evicted blocks is not reused: when
+     * the arena is full, the whole cache is flushed. Returns nullptr if the block doesn't fit even
+     * in the empty arena.
+     */
+    BasicBlock *cache_block(const BlockBuilder &builder);
+    void flush_bb_cache() noexcept;
+
+    // drops the blocks decoded from the code pages that have been written since the last call
+    void invalidate_modified_code();
+
+    // returns false if an exception was raised
+    template<bool kLogging>
+    bool execute_trace(const BasicBlock &bb, std::uintmax_t &instr_count);
+
+    // instructions are 4-byte aligned, so the 2 low bits of pc are not used for indexing
+    DirectMapped<DoubleWord, BasicBlock, std::countr_zero(sizeof(RawInstruction))> bb_cache_;
+
+    // the arena holds kArenaBytesPerBlock bytes per line of the cache
+    static constexpr std::size_t kArenaBytesPerBlock = 1024;
+    Arena bb_arena_;
+
+    std::uintmax_t bb_chain_hits_ = 0;
+    std::uintmax_t bb_cache_flushes_ = 0;
+
+    // execution counters of blocks that are not cached yet; colliding blocks share a counter
+    std::vector<std::uint32_t> cold_executions_;
+
+    std::size_t cold_index(DoubleWord pc) const noexcept
+    {
+        return (pc / sizeof(RawInstruction)) & (cold_executions_.size() - 1);
+    }
+
+    // directions of conditional branches executed in cold code, indexed by cold_index
+    struct BranchCounters final
+    {
+        std::uint32_t taken = 0;
+        std::uint32_t not_taken = 0;
+    };
+    std::vector<BranchCounters> branch_counters_;
+
+    // counts the direction and returns whether it's the one the branch has taken most of the time
+    bool record_branch(DoubleWord pc, bool taken) noexcept
+    {
+        auto &counters = branch_counters_[cold_index(pc)];
+        ++(taken ? counters.taken : counters.not_taken);
+        return taken ? counters.taken >= counters.not_taken
+                     : counters.not_taken >= counters.taken;
+    }
+
+    TierThresholds tier_thresholds_;
+    std::array<std::uintmax_t, kNTiers> tier_executions_{};
+
+    std::unique_ptr<JIT> jit_;
+
+    PredecodedCode predecoded_code_;
 
     bool logging_ = false;
 
@@ -1,6 +1,8 @@
 #ifndef INCLUDE_INSTRUCTION_HPP
 #define INCLUDE_INSTRUCTION_HPP
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 #include "yarvs/common.hpp"
@@ -9,23 +11,41 @@
 namespace yarvs
 {
 
+class Hart;
+
+/*
+ * Instructions are packed into 16 bytes, so that 4 of them share a cache line of a cached block.
+ * The raw encoding is not kept: encode() reassembles it when it's needed (e.g. for mtval).
+ */
 struct Instruction final
 {
     using gpr_index_type = Byte; // shall contain at least 5 bits
-    using immediate_type = DoubleWord;
+    using immediate_type = std::int32_t;
+    using handler_type = bool (*)(Hart &, const Instruction &);
 
-    RawInstruction raw;
+    /*
+     * Executor of the instruction. It's resolved on decoding, so that dispatch is a single indirect
+     * call without looking up a table by id.
+     */
+    handler_type handler;
     InstrID id;
     gpr_index_type rs1;
     gpr_index_type rs2;
     gpr_index_type rd;
 
     /*
-     * 1. sign-extended on decoding
+     * 1. sign-extended to XLEN by the executors: all RV64I immediates fit in 32 bits
      * 2. used as a subscript into CSR regfile
+     * 3. the encoding of kILLEGAL
      */
     immediate_type imm;
 
+    /*
+     * The number of instructions it stands for: 2 for pseudo-instructions fused from pairs by
+     * Decoder::fuse.
+     */
+    std::size_t length() const noexcept { return id >= kFirstFusedID ? 2 : 1; }
+
     bool is_terminator() const noexcept
     {
         switch (id)
@@ -38,10 +58,40 @@ struct Instruction final
             case InstrID::kBNE:
             case InstrID::kEBREAK:
             case InstrID::kECALL:
+            case InstrID::kFENCE_I: // code following it in the block might be stale
             case InstrID::kJAL:
             case InstrID::kJALR:
+#ifndef YARVS_USER_ISA
             case InstrID::kMRET:
             case InstrID::kSRET:
+#endif
+            case InstrID::kAUIPC_JALR:
+            case InstrID::kSLT_BNEZ:
+            case InstrID::kSLT_BEQZ:
+            case InstrID::kSLTU_BNEZ:
+            case InstrID::kSLTU_BEQZ:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // terminators whose targets are known at decoding
+    bool is_direct_jump() const noexcept
+    {
+        switch (id)
+        {
+            case InstrID::kBEQ:
+            case InstrID::kBGE:
+            case InstrID::kBGEU:
+            case InstrID::kBLT:
+            case InstrID::kBLTU:
+            case InstrID::kBNE:
+            case InstrID::kJAL:
+            case InstrID::kSLT_BNEZ:
+            case InstrID::kSLT_BEQZ:
+            case InstrID::kSLTU_BNEZ:
+            case InstrID::kSLTU_BEQZ:
                 return true;
             default:
                 return false;
@@ -49,8 +99,13 @@ struct Instruction final
     }
 
     std::string disassemble() const;
+
+    // generated from risc-v opcodes; fused pseudo-instructions have no encoding
+    RawInstruction encode() const noexcept;
 };
 
+static_assert(sizeof(Instruction) == 16);
+
 } // namespace yarvs
 
 #endif // INCLUDE_INSTRUCTION_HPP
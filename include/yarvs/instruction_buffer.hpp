@@ -0,0 +1,83 @@
+#ifndef INCLUDE_INSTRUCTION_BUFFER_HPP
+#define INCLUDE_INSTRUCTION_BUFFER_HPP
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "yarvs/identifiers.hpp" // generated header
+#include "yarvs/instruction.hpp"
+
+namespace yarvs
+{
+
+/*
+ * Decoded instructions stored as a structure of arrays: every field of Instruction is kept in an
+ * array of its own, so that Decoder::decode_bulk can write the fields of several instructions
+ * with a single vector store.
+ */
+class InstructionBuffer final
+{
+public:
+
+    std::size_t size() const noexcept { return ids_.size(); }
+    bool empty() const noexcept { return ids_.empty(); }
+
+    Instruction operator[](std::size_t i) const noexcept
+    {
+        return Instruction{.handler = handlers_[i], .id = ids_[i], .rs1 = rs1s_[i],
+                           .rs2 = rs2s_[i], .rd = rds_[i], .imm = imms_[i]};
+    }
+
+    void set(std::size_t i, const Instruction &instr) noexcept
+    {
+        handlers_[i] = instr.handler;
+        ids_[i] = instr.id;
+        rs1s_[i] = instr.rs1;
+        rs2s_[i] = instr.rs2;
+        rds_[i] = instr.rd;
+        imms_[i] = instr.imm;
+    }
+
+    void push_back(const Instruction &instr)
+    {
+        handlers_.push_back(instr.handler);
+        ids_.push_back(instr.id);
+        rs1s_.push_back(instr.rs1);
+        rs2s_.push_back(instr.rs2);
+        rds_.push_back(instr.rd);
+        imms_.push_back(instr.imm);
+    }
+
+    void resize(std::size_t size)
+    {
+        handlers_.resize(size);
+        ids_.resize(size);
+        rs1s_.resize(size);
+        rs2s_.resize(size);
+        rds_.resize(size);
+        imms_.resize(size);
+    }
+
+    void clear() noexcept { resize(0); }
+
+    std::span<Instruction::handler_type> handlers() noexcept { return handlers_; }
+    std::span<InstrID> ids() noexcept { return ids_; }
+    std::span<Instruction::gpr_index_type> rs1s() noexcept { return rs1s_; }
+    std::span<Instruction::gpr_index_type> rs2s() noexcept { return rs2s_; }
+    std::span<Instruction::gpr_index_type> rds() noexcept { return rds_; }
+    std::span<Instruction::immediate_type> imms() noexcept { return imms_; }
+
+private:
+
+    std::vector<Instruction::handler_type> handlers_;
+    std::vector<InstrID> ids_;
+    std::vector<Instruction::gpr_index_type> rs1s_;
+    std::vector<Instruction::gpr_index_type> rs2s_;
+    std::vector<Instruction::gpr_index_type> rds_;
+    std::vector<Instruction::immediate_type> imms_;
+};
+
+} // namespace yarvs
+
+#endif // INCLUDE_INSTRUCTION_BUFFER_HPP
@@ -0,0 +1,118 @@
+#ifndef INCLUDE_JIT_JIT_HPP
+#define INCLUDE_JIT_JIT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "yarvs/common.hpp"
+#include "yarvs/instruction.hpp"
+
+#include "yarvs/jit/trace_ir.hpp"
+#include "yarvs/jit/x86_64_emitter.hpp"
+
+#include "yarvs/memory/mmap_wrapper.hpp"
+
+namespace yarvs
+{
+
+class Hart;
+
+/*
+ * Translator of traces of basic blocks into native x86-64 code. A trace is optimized on TraceIR
+ * first. Integer computational and control transfer instructions are compiled into code working
+ * directly on the registers of the hart. Any other instruction (loads, stores, CSR and system
+ * instructions) is executed by calling the fallback handler, which is given the hart and the
+ * instruction as an interpreter handler would be. On an exception the fallback is expected to
+ * return false having called Hart::raise_exception; the translated code stops then.
+ *
+ * Results are always stored to the registers of the hart, but the last one is also kept in rax:
+ * an instruction reading the register it has just been written to takes the value from there
+ * instead of memory. Calls, exits and other writes to rax drop the forwarded value.
+ *
+ * Translated code is placed in a fixed-size buffer and never freed: once the buffer is full,
+ * translate() fails and blocks stay interpreted.
+ */
+class JIT final
+{
+public:
+
+    static constexpr bool kSupported =
+#if defined(__x86_64__) || defined(_M_X64)
+        true;
+#else
+        false;
+#endif
+
+    struct Result final
+    {
+        std::uint32_t n_executed; // not including the instruction that has raised an exception
+        std::uint32_t trapped;    // non-zero if an exception was raised
+    };
+
+    using entry_type = Result (*)(Hart &h, DoubleWord *gprs, DoubleWord *pc);
+
+    // instructions at consecutive addresses
+    struct Segment final
+    {
+        DoubleWord pc;
+        std::span<const Instruction> instrs;
+    };
+
+    static constexpr std::size_t kDefaultCodeBufferSize = std::size_t{64} << 20; // 64MB
+
+    explicit JIT(Instruction::handler_type fallback,
+                 std::size_t code_buffer_size = kDefaultCodeBufferSize);
+
+    /*
+     * Every segment of the trace but the last shall end with a direct jump; the translated code
+     * leaves the trace if the jump does not go to the next segment. Returns nullptr if the code
+     * buffer is exhausted. Instructions shall outlive the translation: the fallback is given
+     * pointers to them.
+     */
+    entry_type translate(std::span<const Segment> trace);
+
+    // drops all the translated code: the entries returned before shall not be called anymore
+    void reset() noexcept { code_size_ = 0; }
+
+    std::uintmax_t translated_blocks() const noexcept { return translated_blocks_; }
+    std::size_t code_size() const noexcept { return code_size_; } // since the last reset
+
+private:
+
+    using Reg = X86_64Emitter::Reg;
+    using Width = X86_64Emitter::Width;
+
+    // returns false if the instruction is to be executed by the fallback
+    bool translate_native(const TraceIR::Node &node);
+    void translate_fallback(const TraceIR::Node &node);
+
+    // the value is loaded as an immediate if it's known or forwarded from rax if it's there
+    void load_gpr(Reg reg, std::size_t i, std::optional<DoubleWord> value = std::nullopt);
+    void store_gpr(std::size_t i, Reg reg);
+    void alu_imm(X86_64Emitter::ALUOp op, Reg reg, DoubleWord imm, Width width = Width::k64);
+
+    void exit(DoubleWord next_pc, std::uint32_t n_executed);
+    void exit(Reg next_pc, std::uint32_t n_executed);
+    void trap(std::uint32_t n_executed);
+
+    TraceIR ir_;
+    X86_64Emitter emitter_;
+    std::vector<X86_64Emitter::Fixup> exits_; // jumps to the epilogue
+    std::optional<DoubleWord> pc_value_; // value of pc_ at the current point of the code
+    std::optional<std::size_t> rax_gpr_; // the register of the hart whose value rax holds
+
+    Instruction::handler_type fallback_;
+
+    MMapWrapper code_buffer_;
+    std::size_t code_buffer_size_;
+    std::size_t code_size_ = 0;
+
+    std::uintmax_t translated_blocks_ = 0;
+};
+
+} // namespace yarvs
+
+#endif // INCLUDE_JIT_JIT_HPP
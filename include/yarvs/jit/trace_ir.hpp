@@ -0,0 +1,80 @@
+#ifndef INCLUDE_JIT_TRACE_IR_HPP
+#define INCLUDE_JIT_TRACE_IR_HPP
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "yarvs/common.hpp"
+#include "yarvs/instruction.hpp"
+
+namespace yarvs
+{
+
+/*
+ * Lightweight IR of a trace the JIT optimizes before emitting code. Instructions keep their
+ * decoded form; the passes annotate them with what is known about them statically:
+ *
+ * 1. constant propagation: values of registers computed from constants (lui/addi chains, auipc,
+ *    link addresses, etc.) are tracked through the trace, so that operands are encoded as
+ *    immediates, results are folded and branches are resolved;
+ * 2. dead write elimination: instructions whose only effect is writing a register that is
+ *    overwritten before being read are dropped. Writes to x0 are always dead.
+ *
+ * Every instruction that may leave the trace (by a trap, a jump or a side exit) reads all the
+ * registers, so the state of the hart is exact wherever the translated code stops.
+ */
+class TraceIR final
+{
+public:
+
+    struct Node final
+    {
+        const Instruction *instr;
+        DoubleWord pc;
+        std::uint32_t n_executed; // the number of instructions of the trace preceding this one
+        std::optional<DoubleWord> next_pc; // address of the next segment if it ends a segment
+
+        bool dead = false;
+        std::optional<DoubleWord> rs1_value;
+        std::optional<DoubleWord> rs2_value;
+        std::optional<DoubleWord> result; // value of rd after a pure instruction
+        std::optional<bool> taken; // direction of a conditional branch
+    };
+
+    void clear() noexcept { nodes_.clear(); }
+
+    void append(const Instruction &instr, DoubleWord pc, std::uint32_t n_executed,
+                std::optional<DoubleWord> next_pc)
+    {
+        nodes_.push_back({.instr = &instr, .pc = pc, .n_executed = n_executed, .next_pc = next_pc});
+    }
+
+    void optimize()
+    {
+        propagate_constants();
+        eliminate_dead_writes();
+    }
+
+    std::span<const Node> nodes() const noexcept { return nodes_; }
+
+    // instructions whose only effect is writing rd: they never trap or jump
+    static bool is_pure(InstrID id) noexcept;
+
+    // the result of a pure instruction if its operands are known
+    static std::optional<DoubleWord> evaluate(const Instruction &instr, DoubleWord pc,
+                                              std::optional<DoubleWord> rs1,
+                                              std::optional<DoubleWord> rs2) noexcept;
+
+private:
+
+    void propagate_constants();
+    void eliminate_dead_writes();
+
+    std::vector<Node> nodes_;
+};
+
+} // namespace yarvs
+
+#endif // INCLUDE_JIT_TRACE_IR_HPP
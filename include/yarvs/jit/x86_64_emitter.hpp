@@ -0,0 +1,297 @@
+#ifndef INCLUDE_JIT_X86_64_EMITTER_HPP
+#define INCLUDE_JIT_X86_64_EMITTER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "yarvs/common.hpp"
+
+namespace yarvs
+{
+
+/*
+ * Minimal x86-64 assembler: it encodes exactly the instructions the JIT needs. Memory operands
+ * are always of the form [base + disp].
+ */
+class X86_64Emitter final
+{
+public:
+
+    enum Reg : Byte
+    {
+        kRAX, kRCX, kRDX, kRBX, kRSP, kRBP, kRSI, kRDI,
+        kR8, kR9, kR10, kR11, kR12, kR13, kR14, kR15
+    };
+
+    enum class Width : Byte
+    {
+        k32,
+        k64
+    };
+
+    // /digit of group 1 instructions; opcodes of their register forms are derived from it
+    enum ALUOp : Byte
+    {
+        kAdd = 0,
+        kOr = 1,
+        kAnd = 4,
+        kSub = 5,
+        kXor = 6,
+        kCmp = 7
+    };
+
+    // /digit of group 2 instructions
+    enum ShiftOp : Byte
+    {
+        kShl = 4,
+        kShr = 5,
+        kSar = 7
+    };
+
+    enum Cond : Byte
+    {
+        kB = 0x2,
+        kAE = 0x3,
+        kE = 0x4,
+        kNE = 0x5,
+        kL = 0xc,
+        kGE = 0xd
+    };
+
+    static constexpr Cond negate(Cond cond) noexcept { return static_cast<Cond>(cond ^ 1); }
+
+    // position of rel32 of a jump whose target is not known yet
+    using Fixup = std::size_t;
+
+    const std::vector<Byte> &code() const noexcept { return code_; }
+    std::size_t size() const noexcept { return code_.size(); }
+
+    void clear() noexcept { code_.clear(); }
+
+    static constexpr bool fits_int32(DoubleWord imm) noexcept
+    {
+        const auto simm = static_cast<std::int64_t>(imm);
+        return std::numeric_limits<std::int32_t>::min() <= simm &&
+               simm <= std::numeric_limits<std::int32_t>::max();
+    }
+
+    void push(Reg reg)
+    {
+        rex(Width::k32, 0, reg);
+        emit(0x50 + (reg & 7));
+    }
+
+    void pop(Reg reg)
+    {
+        rex(Width::k32, 0, reg);
+        emit(0x58 + (reg & 7));
+    }
+
+    void ret() { emit(0xc3); }
+
+    // dst = src
+    void mov(Reg dst, Reg src)
+    {
+        rex(Width::k64, src, dst);
+        emit(0x89);
+        modrm(src, dst);
+    }
+
+    // dst = [base + disp]
+    void load(Reg dst, Reg base, std::int32_t disp)
+    {
+        rex(Width::k64, dst, base);
+        emit(0x8b);
+        modrm(dst, base, disp);
+    }
+
+    // [base + disp] = src
+    void store(Reg base, std::int32_t disp, Reg src)
+    {
+        rex(Width::k64, src, base);
+        emit(0x89);
+        modrm(src, base, disp);
+    }
+
+    // dst = imm; the shortest encoding is chosen
+    void mov(Reg dst, DoubleWord imm)
+    {
+        if (imm == 0)
+            alu(kXor, dst, dst, Width::k32);
+        else if (imm <= std::numeric_limits<Word>::max())
+        {
+            rex(Width::k32, 0, dst);
+            emit(0xb8 + (dst & 7));
+            emit_le(static_cast<Word>(imm));
+        }
+        else if (fits_int32(imm))
+        {
+            rex(Width::k64, 0, dst);
+            emit(0xc7);
+            modrm(0, dst);
+            emit_le(static_cast<Word>(imm));
+        }
+        else
+        {
+            rex(Width::k64, 0, dst);
+            emit(0xb8 + (dst & 7));
+            emit_le(imm);
+        }
+    }
+
+    // dst = dst op src
+    void alu(ALUOp op, Reg dst, Reg src, Width width = Width::k64)
+    {
+        rex(width, src, dst);
+        emit((op << 3) | 0x1); // op r/m, reg
+        modrm(src, dst);
+    }
+
+    // dst = dst op sext(imm)
+    void alu(ALUOp op, Reg dst, std::int32_t imm, Width width = Width::k64)
+    {
+        rex(width, 0, dst);
+        if (std::numeric_limits<std::int8_t>::min() <= imm &&
+            imm <= std::numeric_limits<std::int8_t>::max())
+        {
+            emit(0x83);
+            modrm(op, dst);
+            emit(static_cast<Byte>(imm));
+        }
+        else
+        {
+            emit(0x81);
+            modrm(op, dst);
+            emit_le(static_cast<Word>(imm));
+        }
+    }
+
+    // dst = dst op cl
+    void shift(ShiftOp op, Reg dst, Width width = Width::k64)
+    {
+        rex(width, 0, dst);
+        emit(0xd3);
+        modrm(op, dst);
+    }
+
+    // dst = dst op imm
+    void shift(ShiftOp op, Reg dst, Byte imm, Width width = Width::k64)
+    {
+        rex(width, 0, dst);
+        emit(0xc1);
+        modrm(op, dst);
+        emit(imm);
+    }
+
+    // dst = sext(src[31:0])
+    void movsxd(Reg dst, Reg src)
+    {
+        rex(Width::k64, dst, src);
+        emit(0x63);
+        modrm(dst, src);
+    }
+
+    // dst = cond ? 1 : 0
+    void setcc(Cond cond, Reg dst)
+    {
+        emit(0x40 | (dst >> 3)); // REX is required to address the low byte of rsi, rdi, etc.
+        emit(0x0f, 0x90 + cond);
+        modrm(0, dst);
+
+        emit(0x40 | ((dst >> 3) << 2) | (dst >> 3));
+        emit(0x0f, 0xb6); // movzx
+        modrm(dst, dst);
+    }
+
+    // sets flags on lhs & rhs for the low bytes of the registers
+    void test8(Reg lhs, Reg rhs)
+    {
+        emit(0x40 | ((rhs >> 3) << 2) | (lhs >> 3));
+        emit(0x84);
+        modrm(rhs, lhs);
+    }
+
+    void call(Reg target)
+    {
+        rex(Width::k32, 0, target);
+        emit(0xff);
+        modrm(2, target);
+    }
+
+    [[nodiscard]] Fixup jmp()
+    {
+        emit(0xe9);
+        return emit_rel32();
+    }
+
+    [[nodiscard]] Fixup jcc(Cond cond)
+    {
+        emit(0x0f, 0x80 + cond);
+        return emit_rel32();
+    }
+
+    // makes the jump go to the current position
+    void bind(Fixup fixup) noexcept
+    {
+        const auto rel = static_cast<Word>(code_.size() - (fixup + sizeof(Word)));
+        for (std::size_t i = 0; i != sizeof(Word); ++i)
+            code_[fixup + i] = static_cast<Byte>(rel >> (8 * i));
+    }
+
+private:
+
+    void emit(Byte byte) { code_.push_back(byte); }
+
+    void emit(Byte byte_1, Byte byte_2)
+    {
+        emit(byte_1);
+        emit(byte_2);
+    }
+
+    template<riscv_type T>
+    void emit_le(T value)
+    {
+        for (std::size_t i = 0; i != sizeof(T); ++i)
+            emit(static_cast<Byte>(value >> (8 * i)));
+    }
+
+    Fixup emit_rel32()
+    {
+        const auto fixup = code_.size();
+        emit_le(Word{0});
+        return fixup;
+    }
+
+    // REX prefix is omitted if none of its bits is needed
+    void rex(Width width, Byte reg, Byte rm)
+    {
+        const Byte prefix = 0x40 | ((width == Width::k64) << 3) | ((reg >> 3) << 2) | (rm >> 3);
+        if (prefix != 0x40)
+            emit(prefix);
+    }
+
+    // register-direct addressing
+    void modrm(Byte reg, Byte rm) { emit(0xc0 | ((reg & 7) << 3) | (rm & 7)); }
+
+    // [base + disp] addressing; rsp and r12 as base require SIB byte
+    void modrm(Byte reg, Byte base, std::int32_t disp)
+    {
+        const bool disp8 = std::numeric_limits<std::int8_t>::min() <= disp &&
+                           disp <= std::numeric_limits<std::int8_t>::max();
+        emit(((disp8 ? 0b01 : 0b10) << 6) | ((reg & 7) << 3) | (base & 7));
+        if ((base & 7) == kRSP)
+            emit(0x24);
+        if (disp8)
+            emit(static_cast<Byte>(disp));
+        else
+            emit_le(static_cast<Word>(disp));
+    }
+
+    std::vector<Byte> code_;
+};
+
+} // namespace yarvs
+
+#endif // INCLUDE_JIT_X86_64_EMITTER_HPP
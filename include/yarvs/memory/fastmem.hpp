@@ -0,0 +1,134 @@
+#ifndef INCLUDE_MEMORY_FASTMEM_HPP
+#define INCLUDE_MEMORY_FASTMEM_HPP
+
+#include <array>
+#include <atomic>
+#include <csignal>
+#include <cstddef>
+#include <optional>
+
+#include "yarvs/common.hpp"
+
+namespace yarvs
+{
+
+/*
+ * A host view of the guest virtual address space of Sv39: a region of host address space where
+ * guest pages are mapped onto the pages of the file backing physical memory as they are accessed.
+ * Translated accesses are then single host accesses. Wider address spaces don't fit in the one of
+ * the host.
+ *
+ * The view starts inaccessible. An access to a page that is not mapped for it raises SIGSEGV; the
+ * handler translates the address with the resolver and maps the page read-only for a load and
+ * read-write for a store. If the translation fails, a scratch page is mapped, so that the access
+ * completes, and the access reports the fault.
+ *
+ * SIGSEGV is synchronous with accesses, so the resolver runs as if it was called by the access.
+ */
+class FastMem final
+{
+public:
+
+    static constexpr DoubleWord kVABits = 39;
+    static constexpr DoubleWord kSize = DoubleWord{1} << kVABits;
+
+    // returns the physical address of the page containing va or std::nullopt on a page fault
+    using resolver_type = std::optional<DoubleWord> (*)(void *context, DoubleWord va, bool write);
+
+    /*
+     * fd is the file backing physical memory of the given size. Throws std::system_error, or
+     * std::runtime_error if host pages are not 4KB.
+     */
+    FastMem(int fd, std::size_t phys_mem_size, resolver_type resolver, void *context);
+    ~FastMem();
+
+    FastMem(const FastMem &rhs) = delete;
+    FastMem &operator=(const FastMem &rhs) = delete;
+
+    FastMem(FastMem &&rhs) = delete;
+    FastMem &operator=(FastMem &&rhs) = delete;
+
+    template<riscv_type T>
+    std::optional<T> load(DoubleWord va) noexcept
+    {
+        const auto offset = to_offset(va);
+        if (offset > kSize - sizeof(T)) [[unlikely]] // not canonical
+            return std::nullopt;
+        begin_access(/* write = */ false);
+        const T value = *reinterpret_cast<const volatile T *>(base_ + offset);
+        if (end_access()) [[unlikely]]
+            return std::nullopt;
+        return value;
+    }
+
+    // returns false on a page fault
+    template<riscv_type T>
+    bool store(DoubleWord va, T value) noexcept
+    {
+        const auto offset = to_offset(va);
+        if (offset > kSize - sizeof(T)) [[unlikely]]
+            return false;
+        begin_access(/* write = */ true);
+        *reinterpret_cast<volatile T *>(base_ + offset) = value;
+        return !end_access();
+    }
+
+    // makes the whole view inaccessible again
+    void unmap_all() noexcept;
+    void unmap_page(DoubleWord va) noexcept;
+
+private:
+
+    // canonical addresses [-kSize / 2, kSize / 2) are placed at offsets [0, kSize)
+    static DoubleWord to_offset(DoubleWord va) noexcept { return va + kSize / 2; }
+
+    void begin_access(bool write) noexcept
+    {
+        write_ = write;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+
+    // returns true if the access has faulted
+    bool end_access() noexcept
+    {
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        if (n_scratch_pages_ == 0) [[likely]]
+            return false;
+        drop_scratch_pages();
+        return true;
+    }
+
+    bool contains(const Byte *addr) const noexcept
+    {
+        return base_ <= addr && addr < base_ + kSize;
+    }
+
+    // called by the SIGSEGV handler for addresses within the view
+    void handle_fault(Byte *addr) noexcept;
+    void drop_scratch_pages() noexcept;
+    void reserve(Byte *addr, std::size_t size) noexcept;
+
+    static void install_handler();
+    static void handle_sigsegv(int signo, siginfo_t *info, void *ucontext);
+
+    // views are looked up by the address of the fault
+    static constexpr std::size_t kMaxViews = 64;
+    static std::array<std::atomic<FastMem *>, kMaxViews> views_;
+
+    Byte *base_;
+    int fd_;
+    std::size_t phys_mem_size_;
+    resolver_type resolver_;
+    void *context_;
+
+    bool write_ = false; // the kind of the current access
+    bool populated_ = false; // any page has been mapped since the last unmap_all
+
+    // a misaligned access may span two pages
+    std::array<Byte *, 2> scratch_pages_{};
+    volatile std::size_t n_scratch_pages_ = 0;
+};
+
+} // namespace yarvs
+
+#endif // INCLUDE_MEMORY_FASTMEM_HPP
@@ -1,90 +1,338 @@
 #ifndef INCLUDE_MEMORY_MEMORY_HPP
 #define INCLUDE_MEMORY_MEMORY_HPP
 
+#include <array>
 #include <cstddef>
+#include <cstdint>
 #include <expected>
 #include <iterator>
+#include <memory>
 #include <optional>
+#include <stdexcept>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "yarvs/bits_manipulation.hpp"
 #include "yarvs/common.hpp"
+#include "yarvs/memory/fastmem.hpp"
 #include "yarvs/memory/mmap_wrapper.hpp"
+#include "yarvs/memory/page_bitmap.hpp"
 #include "yarvs/memory/virtual_address.hpp"
 #include "yarvs/memory/pte.hpp"
+#include "yarvs/memory/tlb.hpp"
+#include "yarvs/memory/walk_cache.hpp"
 #include "yarvs/privileged/cs_regfile.hpp"
+#include "yarvs/privileged/supervisor/satp.hpp"
 
 namespace yarvs
 {
 
+struct MemoryOptions final
+{
+    static constexpr std::size_t kDefaultPhysMemSize = std::size_t{4} << 30; // 4GB
+
+    // shall be a positive multiple of the page size
+    std::size_t phys_mem_size = kDefaultPhysMemSize;
+    /*
+     * Sv39 accesses go through a FastMem view: physical memory is then backed by a file, so that
+     * its pages can be mapped into the view. The host shall have 4KB pages.
+     */
+    bool fastmem = false;
+};
+
 class Memory final
 {
 public:
 
-    static constexpr DoubleWord kPageBits = 12;
+    static constexpr DoubleWord kPageBits = yarvs::kPageBits;
     static constexpr DoubleWord kPageSize = 1 << kPageBits;
-    static constexpr std::size_t kPhysMemAmount = 4 * (std::size_t{1} << 30); // 4GB
 
-    explicit Memory(CSRegFile &csrs, const PrivilegeLevel &priv_mode)
-        : physical_mem_{kPhysMemAmount, MMapWrapper::kRead | MMapWrapper::kWrite},
-          csrs_{csrs}, priv_level_{priv_mode} {}
+    /*
+     * Physical memory is only reserved: host pages are committed on first touch. Throws
+     * std::invalid_argument if the size is not valid and std::system_error if the memory can't
+     * be reserved.
+     */
+    explicit Memory(CSRegFile &csrs, const PrivilegeLevel &priv_mode,
+                    const MemoryOptions &options = {})
+        : physical_mem_{checked_size(options.phys_mem_size),
+                        MMapWrapper::kRead | MMapWrapper::kWrite,
+                        options.fastmem ? MMapWrapper::Sharing::kShared
+                                        : MMapWrapper::Sharing::kPrivate},
+          phys_mem_size_{options.phys_mem_size},
+          code_pages_{options.phys_mem_size / kPageSize},
+          csrs_{csrs}, priv_level_{priv_mode}
+    {
+        if (options.fastmem)
+            fastmem_ = std::make_unique<FastMem>(physical_mem_.fd(), phys_mem_size_,
+                                                 &Memory::resolve_fast_access, this);
+        select_access_path();
+    }
+
+    bool fastmem_enabled() const noexcept { return fastmem_ != nullptr; }
+
+    std::size_t phys_mem_size() const noexcept { return phys_mem_size_; }
+    // the number of bytes of physical memory committed by the host
+    std::size_t resident_size() const { return physical_mem_.resident_size(); }
 
     template<riscv_type T>
     std::expected<T, MCause::Exception> load(DoubleWord va)
     {
-        if (!csrs_.is_satp_active(priv_level_))
+        if (!translated_)
+        {
+            if (!in_phys_mem(va, sizeof(T))) [[unlikely]]
+                return std::unexpected{MCause::Exception::kLoadAccessFault};
             return pm_load<T>(va);
-        const auto maybe_pa = translate_address<MemoryAccessType::kRead>(va);
-        if (!maybe_pa.has_value()) [[unlikely]]
+        }
+        if (fast_) [[likely]]
+        {
+            if (auto maybe_value = fastmem_->load<T>(va)) [[likely]]
+                return *maybe_value;
+            return std::unexpected{MCause::Exception::kLoadPageFault};
+        }
+        const Byte *ptr = translate<MemoryAccessType::kRead>(va);
+        if (!ptr) [[unlikely]]
             return std::unexpected{MCause::Exception::kLoadPageFault};
-        return pm_load<T>(*maybe_pa);
+        return host_load<T>(ptr);
     }
 
     template<riscv_type T>
     std::expected<void, MCause::Exception> store(DoubleWord va, T value)
     {
-        if (!csrs_.is_satp_active(priv_level_))
+        if (!translated_)
+        {
+            if (!in_phys_mem(va, sizeof(T))) [[unlikely]]
+                return std::unexpected{MCause::Exception::kStoreAMOAccessFault};
+            if (code_pages_.contains(va >> kPageBits)) [[unlikely]]
+                record_code_write(va >> kPageBits);
             pm_store(va, value);
+        }
+        else if (fast_) [[likely]]
+        {
+            const bool stored = fastmem_->store(va, value);
+            if (n_fast_code_writes_ != 0) [[unlikely]]
+                take_fast_code_writes();
+            if (!stored) [[unlikely]]
+                return std::unexpected{MCause::Exception::kStoreAMOPageFault};
+        }
         else
         {
-            const auto maybe_pa = translate_address<MemoryAccessType::kWrite>(va);
-            if (!maybe_pa.has_value()) [[unlikely]]
+            Byte *ptr = translate<MemoryAccessType::kWrite>(va);
+            if (!ptr) [[unlikely]]
                 return std::unexpected{MCause::Exception::kStoreAMOPageFault};
-            pm_store(*maybe_pa, value);
+            host_store(ptr, value);
         }
         return {};
     }
 
+    // stops at the first failed store and returns its exception
     template<std::input_iterator It>
     requires riscv_type<std::remove_const_t<typename std::iterator_traits<It>::value_type>>
-    void store(DoubleWord va, It first, It last)
+    std::expected<void, MCause::Exception> store(DoubleWord va, It first, It last)
     {
         using value_type = std::remove_const_t<typename std::iterator_traits<It>::value_type>;
         for (std::size_t i = 0; first != last; ++first, ++i)
-            store(va + i * sizeof(value_type), *first);
+            if (auto res = store(va + i * sizeof(value_type), *first); !res) [[unlikely]]
+                return res;
+        return {};
     }
 
     std::expected<RawInstruction, MCause::Exception> fetch(DoubleWord va)
     {
-        if (!csrs_.is_satp_active(priv_level_))
-            return pm_load<RawInstruction>(va);
-        const auto maybe_pa = translate_address<MemoryAccessType::kExecute>(va);
-        if (!maybe_pa.has_value()) [[unlikely]]
-            return std::unexpected{MCause::Exception::kInstrPageFault};
-        return pm_load<RawInstruction>(*maybe_pa);
+        DoubleWord ppn;
+        return fetch(va, ppn);
+    }
+
+    // also reports the physical page number of the instruction
+    std::expected<RawInstruction, MCause::Exception> fetch(DoubleWord va, DoubleWord &ppn)
+    {
+        const Byte *ptr;
+        if (!translated_)
+        {
+            if (!in_phys_mem(va, sizeof(RawInstruction))) [[unlikely]]
+                return std::unexpected{MCause::Exception::kInstrAccessFault};
+            ptr = &physical_mem_[va];
+        }
+        else
+        {
+            ptr = translate<MemoryAccessType::kExecute>(va);
+            if (!ptr) [[unlikely]]
+                return std::unexpected{MCause::Exception::kInstrPageFault};
+        }
+        ppn = static_cast<DoubleWord>(ptr - &physical_mem_[0]) >> kPageBits;
+        mark_code_page(ppn);
+        return host_load<RawInstruction>(ptr);
     }
 
     std::expected<const Byte *, MCause::Exception> host_ptr(DoubleWord va)
     {
-        if (!csrs_.is_satp_active(priv_level_))
+        if (!translated_)
+        {
+            if (!in_phys_mem(va, 1)) [[unlikely]]
+                return std::unexpected{MCause::Exception::kLoadAccessFault};
             return &physical_mem_[va];
-        const auto maybe_pa = translate_address<MemoryAccessType::kRead>(va);
-        if (!maybe_pa.has_value()) [[unlikely]]
+        }
+        const Byte *ptr = translate<MemoryAccessType::kRead>(va);
+        if (!ptr) [[unlikely]]
             return std::unexpected{MCause::Exception::kLoadPageFault};
-        return &physical_mem_[*maybe_pa];
+        return ptr;
+    }
+
+    /*
+     * Shall be called every time the translation context changes: on writes to mstatus (MXR, SUM,
+     * MPRV and MPP affect translation), on changes of the privilege level and on switching address
+     * translation on or off in satp.
+     */
+    void flush_tlb() noexcept
+    {
+        for (auto &tlb : tlbs_)
+            tlb.flush();
+        walk_cache_.flush();
+        select_access_path();
+    }
+
+    /*
+     * Accesses don't look at the translation context: whether addresses are translated, the ASID
+     * and the page walk of the mode in satp are selected here. Shall be called every time the
+     * privilege level, satp or mstatus change; flush_tlb calls it as well.
+     */
+    void select_access_path() noexcept
+    {
+        const SATP satp = csrs_.get_satp();
+        translated_ = csrs_.is_satp_active(priv_level_) && satp.get_mode() != SATP::Mode::kBare;
+        asid_ = satp.get_asid();
+
+        // the view caches translations of a single context like TLBs do
+        fast_ = fastmem_ && translated_ && satp.get_mode() == SATP::Mode::kSv39;
+        unmap_fastmem();
+
+        switch (satp.get_mode())
+        {
+            case SATP::Mode::kSv48:
+                walks_ = make_walks</*kLevels=*/4>();
+                break;
+            case SATP::Mode::kSv57:
+                walks_ = make_walks</*kLevels=*/5>();
+                break;
+            default: // Sv39; Bare isn't translated
+                walks_ = make_walks</*kLevels=*/3>();
+                break;
+        }
+    }
+
+    /*
+     * Implements the semantics of SFENCE.VMA:
+     * 1) no va and no asid: all translations are invalidated;
+     * 2) no va: non-global translations of the address space asid are invalidated;
+     * 3) no asid: translations of the page containing va are invalidated in all address spaces;
+     * 4) otherwise, the non-global translation of the page containing va in the address space
+     *    asid is invalidated.
+     */
+    void sfence_vma(std::optional<DoubleWord> va, std::optional<HalfWord> asid) noexcept
+    {
+        // the view only holds translations of the current address space; superpages are mapped
+        // page by page, so the pages of the one containing va might be anywhere in it
+        if (fastmem_ && va.has_value() && !fast_superpages_)
+            fastmem_->unmap_page(*va);
+        else
+            unmap_fastmem();
+
+        for (auto &tlb : tlbs_)
+        {
+            if (va.has_value())
+            {
+                const DoubleWord vpn = *va >> kPageBits;
+                if (asid.has_value())
+                    tlb.flush_page(vpn, *asid);
+                else
+                    tlb.flush_page(vpn);
+            }
+            else if (asid.has_value())
+                tlb.flush_asid(*asid);
+            else
+                tlb.flush();
+        }
+
+        if (va.has_value())
+        {
+            if (asid.has_value())
+                walk_cache_.flush_page(*va, *asid);
+            else
+                walk_cache_.flush_page(*va);
+        }
+        else if (asid.has_value())
+            walk_cache_.flush_asid(*asid);
+        else
+            walk_cache_.flush();
+    }
+
+    /*
+     * Self-modifying code detection. Pages instructions are fetched from are marked as code pages.
+     * The first store to a code page unmarks it and records its number, so that the code decoded
+     * from the page can be invalidated. Write translations of code pages are never cached in TLB,
+     * hence stores to other pages are checked on TLB misses only.
+     */
+    bool code_modified() const noexcept
+    {
+        return all_code_modified_ || !modified_code_pages_.empty();
+    }
+
+    // fetches mark pages implicitly; code decoded by other means shall be marked explicitly
+    void mark_code_page(DoubleWord ppn)
+    {
+        if (ppn >= phys_mem_size_ / kPageSize || code_pages_.contains(ppn)) [[likely]]
+            return;
+        code_pages_.insert(ppn);
+        tlbs_[MemoryAccessType::kWrite].flush(); // it might cache a translation to the page
+        unmap_fastmem(); // the page might be mapped for writing
+    }
+
+    // set by FENCE.I: all the decoded code shall be invalidated
+    bool all_code_modified() const noexcept { return all_code_modified_; }
+
+    const std::vector<DoubleWord> &modified_code_pages() const noexcept
+    {
+        return modified_code_pages_;
+    }
+
+    void reset_code_modified() noexcept
+    {
+        all_code_modified_ = false;
+        modified_code_pages_.clear();
     }
 
+    // implements the semantics of FENCE.I: instruction fetches observe all the preceding stores
+    void fence_i() noexcept
+    {
+        code_pages_.clear();
+        all_code_modified_ = true;
+    }
+
+    std::uintmax_t tlb_hits() const noexcept
+    {
+        std::uintmax_t hits = 0;
+        for (const auto &tlb : tlbs_)
+            hits += tlb.hits();
+        return hits;
+    }
+
+    std::uintmax_t tlb_misses() const noexcept
+    {
+        std::uintmax_t misses = 0;
+        for (const auto &tlb : tlbs_)
+            misses += tlb.misses();
+        return misses;
+    }
+
+    // the number of page walks started at a cached table of the given level
+    std::uintmax_t walk_cache_hits(std::size_t level) const noexcept
+    {
+        return walk_cache_.hits(level);
+    }
+
+    // the number of page walks started at the root
+    std::uintmax_t walk_cache_misses() const noexcept { return walk_cache_.misses(); }
+
 private:
 
     enum MemoryAccessType
@@ -94,32 +342,121 @@ private:
         kExecute
     };
 
+    static constexpr std::size_t kTLBSize = 256;
+    static constexpr std::size_t kWalkCacheSize = 32; // per level
+
+    static std::size_t checked_size(std::size_t phys_mem_size)
+    {
+        if (phys_mem_size == 0 || phys_mem_size % kPageSize != 0)
+            throw std::invalid_argument{"physical memory size shall be a multiple of 4KB"};
+        return phys_mem_size;
+    }
+
+    bool in_phys_mem(DoubleWord pa, std::size_t size) const noexcept
+    {
+        return pa <= phys_mem_size_ - size;
+    }
+
+    void record_code_write(DoubleWord ppn)
+    {
+        code_pages_.erase(ppn);
+        modified_code_pages_.push_back(ppn);
+    }
+
+    // called once the access the resolver has run for is complete
+    void take_fast_code_writes()
+    {
+        for (std::size_t i = 0; i != n_fast_code_writes_; ++i)
+            modified_code_pages_.push_back(fast_code_writes_[i]);
+        n_fast_code_writes_ = 0;
+    }
+
+    /*
+     * Returns the host address corresponding to va or nullptr if the translation fails. Page walk
+     * is only performed on TLB miss.
+     */
     template<MemoryAccessType kAccessKind>
-    std::optional<DoubleWord> translate_address(DoubleWord va)
+    Byte *translate(DoubleWord va)
     {
-        switch (csrs_.get_satp().get_mode())
+        auto &tlb = tlbs_[kAccessKind];
+        const DoubleWord vpn = va >> kPageBits;
+        Byte *page = tlb.lookup(vpn, asid_);
+        if (!page) [[unlikely]]
         {
-            case SATP::Mode::kBare:
-                return va;
-            case SATP::Mode::kSv39:
-                if (va != sext<39, DoubleWord>(va))
-                    return std::nullopt;
-                return translate_address<kAccessKind, /*kLevels=*/3>(va);
-            case SATP::Mode::kSv48:
-                if (va != sext<48, DoubleWord>(va))
-                    return std::nullopt;
-                return translate_address<kAccessKind, /*kLevels=*/4>(va);
-            case SATP::Mode::kSv57:
-                if (va != sext<57, DoubleWord>(va))
-                    return std::nullopt;
-                return translate_address<kAccessKind, /*kLevels=*/5>(va);
-            default: [[unlikely]]
-                std::unreachable();
+            const auto maybe_translation = (this->*walks_[kAccessKind])(va);
+            if (!maybe_translation.has_value()) [[unlikely]]
+                return nullptr;
+            page = &physical_mem_[mask_bits<63, kPageBits>(maybe_translation->pa)];
+
+            const DoubleWord ppn = maybe_translation->pa >> kPageBits;
+            if (kAccessKind == MemoryAccessType::kWrite && code_pages_.contains(ppn)) [[unlikely]]
+                record_code_write(ppn); // not cached, so every store to the page is checked
+            else
+                tlb.update(vpn, asid_, maybe_translation->global, maybe_translation->level,
+                           page);
+        }
+        return page + mask_bits<kPageBits - 1, 0>(va);
+    }
+
+    void unmap_fastmem() noexcept
+    {
+        if (fastmem_)
+            fastmem_->unmap_all();
+        fast_superpages_ = false;
+    }
+
+    /*
+     * The resolver of the FastMem view; writes to code pages are checked as on TLB misses. It
+     * runs in the signal handler, so it doesn't allocate: writes to code pages are put aside and
+     * recorded once the access is complete.
+     */
+    static std::optional<DoubleWord> resolve_fast_access(void *context, DoubleWord va, bool write)
+    {
+        auto &mem = *static_cast<Memory *>(context);
+        const auto kind = write ? MemoryAccessType::kWrite : MemoryAccessType::kRead;
+        const auto maybe_translation = (mem.*mem.walks_[kind])(va);
+        if (!maybe_translation.has_value())
+            return std::nullopt;
+
+        const DoubleWord ppn = maybe_translation->pa >> kPageBits;
+        if (write && mem.code_pages_.contains(ppn)) [[unlikely]]
+        {
+            mem.code_pages_.erase(ppn); // unmarked, so the page may be mapped for writing
+            mem.fast_code_writes_[mem.n_fast_code_writes_++] = ppn;
         }
+        mem.fast_superpages_ |= maybe_translation->level != 0;
+        return ppn << kPageBits;
+    }
+
+    struct Translation final
+    {
+        DoubleWord pa;
+        bool global; // the mapping exists in all address spaces
+        Byte level; // of the leaf PTE; superpages have non-zero levels
+    };
+
+    using walk_type = std::optional<Translation> (Memory::*)(DoubleWord va);
+
+    // page walks of an Sv mode indexed by MemoryAccessType
+    template<Byte kLevels>
+    static constexpr std::array<walk_type, 3> make_walks() noexcept
+    {
+        return {&Memory::walk<MemoryAccessType::kRead, kLevels>,
+                &Memory::walk<MemoryAccessType::kWrite, kLevels>,
+                &Memory::walk<MemoryAccessType::kExecute, kLevels>};
+    }
+
+    template<MemoryAccessType kAccessKind, Byte kLevels>
+    std::optional<Translation> walk(DoubleWord va)
+    {
+        constexpr auto kVABits = kPageBits + 9 * kLevels;
+        if (va != sext<kVABits, DoubleWord>(va))
+            return std::nullopt;
+        return translate_address<kAccessKind, kLevels>(va);
     }
 
     template<MemoryAccessType kAccessKind, Byte kLevels>
-    std::optional<DoubleWord> translate_address(VirtualAddress va)
+    std::optional<Translation> translate_address(VirtualAddress va)
     {
         static_assert(3 <= kLevels && kLevels <= 5);
 
@@ -127,10 +464,20 @@ private:
         DoubleWord a = csrs_.get_satp().get_ppn() * kPageSize;
 
         PTE pte;
-        auto i = kLevels - 1;
+        bool global = false; // G bit of a non-leaf PTE applies to all subsequent levels
+        Byte i = kLevels - 1;
+        if (const auto table = walk_cache_.lookup<kLevels>(va, asid_))
+        {
+            a = table->pa;
+            global = table->global;
+            i = table->level;
+        }
+
         for (;;)
         {
             const DoubleWord pa = a + va.get_vpn(i) * sizeof(PTE);
+            if (!in_phys_mem(pa, sizeof(PTE)))
+                return std::nullopt;
             pte = pm_load<DoubleWord>(pa);
 
             if (!pte.get_V() || pte.is_rwx_reserved() || pte.uses_reserved())
@@ -138,12 +485,15 @@ private:
 
             // PTE is valid
 
+            global |= pte.get_G();
+
             if (pte.is_pointer_to_next_level_pte())
             {
                 if (i == 0)
                     return std::nullopt;
                 --i;
                 a = pte.get_whole_ppn();
+                walk_cache_.update(va, asid_, {.pa = a, .level = i, .global = global});
                 continue;
             }
 
@@ -151,7 +501,7 @@ private:
 
             if constexpr (kAccessKind == MemoryAccessType::kRead)
             {
-                if (mstatus.get_mxr())
+                if (!kUserISA && mstatus.get_mxr())
                 {
                     if (!pte.get_R() && !pte.get_E())
                         return std::nullopt;
@@ -170,12 +520,19 @@ private:
                     return std::nullopt;
             }
 
-            if (priv_level_ == PrivilegeLevel::kSupervisor && pte.get_U() && !mstatus.get_sum())
+            if (!kUserISA && priv_level_ == PrivilegeLevel::kSupervisor && pte.get_U() &&
+                !mstatus.get_sum())
                 return std::nullopt;
 
             if (i > 0 && pte.get_lower_ppn<kLevels>(i - 1)) // misaligned superpage
                 return std::nullopt;
 
+            DoubleWord result = pte.get_upper_ppn<kLevels>(i) | va.get_page_offset();
+            if (i > 0) // superpage translation: the lower PPNs are taken from va
+                result |= mask_bits(DoubleWord{va}, kPageBits + 9 * i - 1, kPageBits);
+            if (!in_phys_mem(result, 1))
+                return std::nullopt;
+
             if constexpr (kAccessKind == MemoryAccessType::kWrite) {
                 if (!pte.get_A() || !pte.get_D())
                 {
@@ -196,11 +553,7 @@ private:
             }
 
             pm_store(pa, +pte);
-
-            DoubleWord result = pte.get_upper_ppn<kLevels>(i) | va.get_page_offset();
-            if (i > 0) // superpage translation
-                result |= pte.get_lower_ppn<kLevels>(i - 1);
-            return result;
+            return Translation{.pa = result, .global = global, .level = i};
         }
     }
 
@@ -210,9 +563,36 @@ private:
     template<riscv_type T>
     void pm_store(DoubleWord pa, T value) { *reinterpret_cast<T*>(&physical_mem_[pa]) = value; }
 
+    template<riscv_type T>
+    static T host_load(const Byte *ptr) noexcept { return *reinterpret_cast<const T *>(ptr); }
+
+    template<riscv_type T>
+    static void host_store(Byte *ptr, T value) noexcept { *reinterpret_cast<T *>(ptr) = value; }
+
+    // the fields used by every access precede the TLBs, which take several kilobytes
     MMapWrapper physical_mem_;
+    std::size_t phys_mem_size_;
+    PageBitmap code_pages_; // allocated as code is fetched, so a large memory costs nothing
+
+    // the access path selected for the translation context
+    bool translated_ = false;
+    bool fast_ = false; // accesses go through fastmem_
+    bool fast_superpages_ = false; // fastmem_ has mapped a page of a superpage since unmap_all
+    HalfWord asid_ = 0;
+    std::array<walk_type, 3> walks_;
+    std::unique_ptr<FastMem> fastmem_;
+    // an access spans 2 pages at most, so it makes 2 writes to code pages at most
+    std::array<DoubleWord, 2> fast_code_writes_;
+    std::size_t n_fast_code_writes_ = 0;
+
     CSRegFile &csrs_;
     const PrivilegeLevel &priv_level_;
+
+    std::array<TLB<kTLBSize>, 3> tlbs_; // indexed by MemoryAccessType
+    PageWalkCache<kWalkCacheSize> walk_cache_; // shared by all access kinds
+
+    std::vector<DoubleWord> modified_code_pages_;
+    bool all_code_modified_ = false;
 };
 
 } // namespace yarvs
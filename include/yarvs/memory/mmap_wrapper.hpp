@@ -1,6 +1,7 @@
 #ifndef INCLUDE_MEMORY_MMAP_WRAPPER_HPP
 #define INCLUDE_MEMORY_MMAP_WRAPPER_HPP
 
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
 #include <cstddef>
@@ -9,8 +10,11 @@
 #include <memory>
 #include <system_error>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <sys/mman.h>
+#include <unistd.h>
 
 namespace yarvs
 {
@@ -28,12 +32,45 @@ class MMapWrapper final
             assert(res == 0);
         }
 
+        std::size_t size() const noexcept { return size_; }
+
     private:
         std::size_t size_;
     };
 
+    class FileDescriptor final
+    {
+    public:
+        explicit FileDescriptor(int fd = -1) noexcept : fd_{fd} {}
+
+        FileDescriptor(FileDescriptor &&rhs) noexcept : fd_{std::exchange(rhs.fd_, -1)} {}
+        FileDescriptor &operator=(FileDescriptor &&rhs) noexcept
+        {
+            std::swap(fd_, rhs.fd_);
+            return *this;
+        }
+
+        ~FileDescriptor()
+        {
+            if (fd_ != -1)
+                close(fd_);
+        }
+
+        int get() const noexcept { return fd_; }
+
+    private:
+        int fd_;
+    };
+
 public:
 
+    // shared memory is backed by an anonymous file, so its pages can be mapped elsewhere as well
+    enum class Sharing : std::uint8_t
+    {
+        kPrivate,
+        kShared
+    };
+
     enum ProtMode : std::uint8_t
     {
         kNone = PROT_NONE,
@@ -42,7 +79,35 @@ public:
         kExec = PROT_EXEC
     };
 
-    MMapWrapper(std::size_t len, ProtMode prot) : mem_{perform_map(len, prot), Unmapper{len}} {}
+    MMapWrapper(std::size_t len, ProtMode prot, Sharing sharing = Sharing::kPrivate)
+        : fd_{sharing == Sharing::kShared ? create_file(len) : FileDescriptor{}},
+          mem_{perform_map(len, prot), Unmapper{len}}
+    {}
+
+    // the file backing the memory or -1: private memory falls back to one if it can't be reserved
+    int fd() const noexcept { return fd_.get(); }
+
+    std::size_t size() const noexcept { return mem_.get_deleter().size(); }
+
+    // the number of bytes backed by host pages: pages are committed on first touch
+    std::size_t resident_size() const
+    {
+        const auto page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        constexpr std::size_t kChunkPages = 1 << 16;
+        std::vector<unsigned char> residency(kChunkPages);
+
+        std::size_t n_resident = 0;
+        for (std::size_t offset = 0; offset < size(); offset += kChunkPages * page_size)
+        {
+            const auto len = std::min(size() - offset, kChunkPages * page_size);
+            if (mincore(mem_.get() + offset, len, residency.data()) == -1) [[unlikely]]
+                throw std::system_error{errno, std::system_category(), "mincore() failed"};
+            const auto n_pages = (len + page_size - 1) / page_size;
+            n_resident += std::count_if(residency.begin(), residency.begin() + n_pages,
+                                        [](unsigned char page) { return page & 1; });
+        }
+        return n_resident * page_size;
+    }
 
     const std::uint8_t &operator[](std::size_t i) const noexcept { return mem_[i]; }
     std::uint8_t &operator[](std::size_t i) noexcept { return mem_[i]; }
@@ -59,13 +124,40 @@ private:
      */
     std::uint8_t *perform_map(std::size_t len, ProtMode prot)
     {
-        auto ptr = static_cast<std::uint8_t *>(mmap(NULL, len, prot, MAP_PRIVATE | MAP_ANONYMOUS,
-                                                    -1 /* fd */, 0 /* offset */));
-        if (ptr == MAP_FAILED) [[unlikely]]
-            throw std::system_error{errno, std::system_category(), "mmap() failed"};
-        return ptr;
+        // private memory isn't accounted for in advance unless overcommit is disabled
+        void *ptr = MAP_FAILED;
+        if (fd_.get() == -1)
+        {
+            ptr = mmap(NULL, len, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                       -1 /* fd */, 0 /* offset */);
+            if (ptr == MAP_FAILED && errno != ENOMEM) [[unlikely]]
+                throw std::system_error{errno, std::system_category(), "mmap() failed"};
+        }
+
+        // pages of an anonymous file are accounted for as they are allocated under any policy
+        if (ptr == MAP_FAILED)
+        {
+            if (fd_.get() == -1)
+                fd_ = create_file(len);
+            ptr = mmap(NULL, len, prot, MAP_SHARED | MAP_NORESERVE, fd_.get(), 0 /* offset */);
+            if (ptr == MAP_FAILED) [[unlikely]]
+                throw std::system_error{errno, std::system_category(), "mmap() failed"};
+        }
+        return static_cast<std::uint8_t *>(ptr);
+    }
+
+    // pages of the file are allocated on first touch just like the ones of anonymous memory
+    static FileDescriptor create_file(std::size_t len)
+    {
+        FileDescriptor fd{memfd_create("yarvs-memory", MFD_CLOEXEC)};
+        if (fd.get() == -1) [[unlikely]]
+            throw std::system_error{errno, std::system_category(), "memfd_create() failed"};
+        if (ftruncate(fd.get(), static_cast<off_t>(len)) == -1) [[unlikely]]
+            throw std::system_error{errno, std::system_category(), "ftruncate() failed"};
+        return fd;
     }
 
+    FileDescriptor fd_; // closed after the memory is unmapped
     std::unique_ptr<std::uint8_t[], Unmapper> mem_;
 };
 
@@ -0,0 +1,80 @@
+#ifndef INCLUDE_MEMORY_PAGE_BITMAP_HPP
+#define INCLUDE_MEMORY_PAGE_BITMAP_HPP
+
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "yarvs/common.hpp"
+
+namespace yarvs
+{
+
+/*
+ * Set of physical page numbers. The bitmap is split into chunks allocated as their pages are
+ * added, so its host memory is proportional to the memory the set spans rather than to the size
+ * of physical memory.
+ */
+class PageBitmap final
+{
+public:
+
+    explicit PageBitmap(std::size_t n_pages)
+        : chunks_((n_pages + kChunkPages - 1) / kChunkPages)
+    {}
+
+    bool contains(DoubleWord ppn) const noexcept
+    {
+        const auto chunk = ppn / kChunkPages;
+        if (chunk >= chunks_.size() || !chunks_[chunk]) [[likely]]
+            return false;
+        return (word(ppn) >> (ppn % kBitsPerWord)) & 1;
+    }
+
+    // pages out of the range of the bitmap are ignored
+    void insert(DoubleWord ppn)
+    {
+        const auto chunk = ppn / kChunkPages;
+        if (chunk >= chunks_.size())
+            return;
+        if (!chunks_[chunk])
+            chunks_[chunk] = std::make_unique<Chunk>();
+        word(ppn) |= DoubleWord{1} << (ppn % kBitsPerWord);
+    }
+
+    void erase(DoubleWord ppn) noexcept
+    {
+        if (contains(ppn))
+            word(ppn) &= ~(DoubleWord{1} << (ppn % kBitsPerWord));
+    }
+
+    // chunks are kept for the pages to be added again
+    void clear() noexcept
+    {
+        for (auto &chunk : chunks_)
+            if (chunk)
+                chunk->fill(0);
+    }
+
+private:
+
+    static constexpr std::size_t kBitsPerWord = std::numeric_limits<DoubleWord>::digits;
+    static constexpr std::size_t kChunkWords = 512; // 128MB of physical memory per chunk
+    static constexpr std::size_t kChunkPages = kChunkWords * kBitsPerWord;
+
+    using Chunk = std::array<DoubleWord, kChunkWords>;
+
+    // the chunk of ppn shall be allocated
+    DoubleWord &word(DoubleWord ppn) const noexcept
+    {
+        return (*chunks_[ppn / kChunkPages])[ppn % kChunkPages / kBitsPerWord];
+    }
+
+    std::vector<std::unique_ptr<Chunk>> chunks_;
+};
+
+} // namespace yarvs
+
+#endif // INCLUDE_MEMORY_PAGE_BITMAP_HPP
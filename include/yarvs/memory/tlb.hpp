@@ -0,0 +1,140 @@
+#ifndef INCLUDE_MEMORY_TLB_HPP
+#define INCLUDE_MEMORY_TLB_HPP
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+#include "yarvs/common.hpp"
+
+namespace yarvs
+{
+
+/*
+ * Direct-mapped translation look-aside buffer. It maps virtual page numbers onto host addresses
+ * of the corresponding physical pages. Permissions are not stored in entries: every access kind
+ * (read, write, execute) is supposed to have a TLB of its own, so presence of an entry means that
+ * the access is allowed in the current translation context.
+ *
+ * Entries are tagged with the ASID of the address space they belong to, so that switching between
+ * address spaces does not require a flush. Global mappings match any ASID.
+ *
+ * A superpage is cached as separate entries for the pages it's accessed through. They all record
+ * the level of the leaf PTE, so that flushing any page of the superpage invalidates all of them.
+ */
+template<std::size_t kSize>
+class TLB final
+{
+    static_assert(std::has_single_bit(kSize), "the number of entries shall be a power of 2");
+
+public:
+
+    using counter_type = std::uintmax_t;
+
+    TLB() noexcept { flush(); }
+
+    // returns nullptr on miss
+    Byte *lookup(DoubleWord vpn, HalfWord asid) noexcept
+    {
+        const auto &entry = entries_[vpn % kSize];
+        if (entry.vpn == vpn && (entry.asid == asid || entry.global)) [[likely]]
+        {
+            ++hits_;
+            return entry.page;
+        }
+        ++misses_;
+        return nullptr;
+    }
+
+    // level is the one of the leaf PTE: 0 for a page, 1 for a megapage and so on
+    void update(DoubleWord vpn, HalfWord asid, bool global, Byte level, Byte *page) noexcept
+    {
+        entries_[vpn % kSize] = {.vpn = vpn, .page = page, .asid = asid, .global = global,
+                                 .level = level};
+        has_superpages_ |= level != 0;
+    }
+
+    // invalidates all entries
+    void flush() noexcept
+    {
+        entries_.fill(Entry{.vpn = kInvalidVPN});
+        has_superpages_ = false;
+    }
+
+    // invalidates entries for the given page in all address spaces
+    void flush_page(DoubleWord vpn) noexcept
+    {
+        flush_page_if(vpn, [](const Entry &) { return true; });
+    }
+
+    // invalidates non-global entries for the given page in the given address space
+    void flush_page(DoubleWord vpn, HalfWord asid) noexcept
+    {
+        flush_page_if(vpn, [asid](const Entry &entry)
+        {
+            return entry.asid == asid && !entry.global;
+        });
+    }
+
+    // invalidates all non-global entries of the given address space
+    void flush_asid(HalfWord asid) noexcept
+    {
+        for (auto &entry : entries_)
+            if (entry.asid == asid && !entry.global)
+                entry.vpn = kInvalidVPN;
+    }
+
+    static constexpr std::size_t size() noexcept { return kSize; }
+
+    counter_type hits() const noexcept { return hits_; }
+    counter_type misses() const noexcept { return misses_; }
+
+private:
+
+    // virtual page numbers are at most 52 bits wide, so this value never matches a real one
+    static constexpr DoubleWord kInvalidVPN = ~DoubleWord{0};
+
+    struct Entry final
+    {
+        DoubleWord vpn;
+        Byte *page = nullptr;
+        HalfWord asid = 0;
+        bool global = false;
+        Byte level = 0;
+    };
+
+    // whether the entry translates a page of the same (super)page as vpn
+    static bool covers(const Entry &entry, DoubleWord vpn) noexcept
+    {
+        const auto shift = 9 * entry.level;
+        return (entry.vpn >> shift) == (vpn >> shift);
+    }
+
+    /*
+     * The entries of a superpage are spread over the whole TLB, so they're all looked at if there
+     * may be any. Otherwise, only the entry vpn maps onto can translate the page.
+     */
+    template<typename Pred>
+    void flush_page_if(DoubleWord vpn, Pred pred) noexcept
+    {
+        if (has_superpages_) [[unlikely]]
+        {
+            for (auto &entry : entries_)
+                if (covers(entry, vpn) && pred(entry))
+                    entry.vpn = kInvalidVPN;
+        }
+        else if (auto &entry = entries_[vpn % kSize]; entry.vpn == vpn && pred(entry))
+            entry.vpn = kInvalidVPN;
+    }
+
+    std::array<Entry, kSize> entries_;
+    bool has_superpages_ = false; // an entry of a superpage has been added since the last flush
+
+    counter_type hits_ = 0;
+    counter_type misses_ = 0;
+};
+
+} // namespace yarvs
+
+#endif // INCLUDE_MEMORY_TLB_HPP
@@ -0,0 +1,141 @@
+#ifndef INCLUDE_MEMORY_WALK_CACHE_HPP
+#define INCLUDE_MEMORY_WALK_CACHE_HPP
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include "yarvs/common.hpp"
+
+namespace yarvs
+{
+
+// Sv57 has 5 levels of page tables; the root isn't cached
+inline constexpr std::size_t kNWalkCacheLevels = 4;
+
+/*
+ * Direct-mapped cache of page tables below the root. A table of level i is reached from the root
+ * through the PTEs selected by VPN[kLevels - 1] ... VPN[i + 1], so it's keyed by that prefix of
+ * the virtual address. A page walk starts at the lowest cached table instead of the root.
+ *
+ * Like TLB entries, entries are tagged with ASID and are global if a PTE on the way is global.
+ */
+template<std::size_t kSize>
+class PageWalkCache final
+{
+    static_assert(std::has_single_bit(kSize), "the number of entries shall be a power of 2");
+
+public:
+
+    using counter_type = std::uintmax_t;
+
+    static constexpr std::size_t kNLevels = kNWalkCacheLevels;
+
+    struct Table final
+    {
+        DoubleWord pa;
+        Byte level;
+        bool global;
+    };
+
+    PageWalkCache() noexcept { flush(); }
+
+    // returns the lowest cached table on the walk of va with kLevels levels
+    template<Byte kLevels>
+    std::optional<Table> lookup(DoubleWord va, HalfWord asid) noexcept
+    {
+        static_assert(kLevels - 1 <= kNLevels);
+        for (Byte level = 0; level != kLevels - 1; ++level)
+        {
+            const DoubleWord prefix = get_prefix(va, level);
+            const auto &entry = entries_[level][prefix % kSize];
+            if (entry.prefix == prefix && (entry.asid == asid || entry.global))
+            {
+                ++hits_[level];
+                return Table{.pa = entry.pa, .level = level, .global = entry.global};
+            }
+        }
+        ++misses_;
+        return std::nullopt;
+    }
+
+    void update(DoubleWord va, HalfWord asid, const Table &table) noexcept
+    {
+        const DoubleWord prefix = get_prefix(va, table.level);
+        entries_[table.level][prefix % kSize] = {.prefix = prefix, .pa = table.pa, .asid = asid,
+                                                 .global = table.global};
+    }
+
+    // invalidates all entries
+    void flush() noexcept
+    {
+        for (auto &level : entries_)
+            level.fill(Entry{.prefix = kInvalidPrefix});
+    }
+
+    // invalidates entries on the walk of va in all address spaces
+    void flush_page(DoubleWord va) noexcept
+    {
+        for (Byte level = 0; level != kNLevels; ++level)
+        {
+            const DoubleWord prefix = get_prefix(va, level);
+            if (auto &entry = entries_[level][prefix % kSize]; entry.prefix == prefix)
+                entry.prefix = kInvalidPrefix;
+        }
+    }
+
+    // invalidates non-global entries on the walk of va in the given address space
+    void flush_page(DoubleWord va, HalfWord asid) noexcept
+    {
+        for (Byte level = 0; level != kNLevels; ++level)
+        {
+            const DoubleWord prefix = get_prefix(va, level);
+            if (auto &entry = entries_[level][prefix % kSize];
+                entry.prefix == prefix && entry.asid == asid && !entry.global)
+                entry.prefix = kInvalidPrefix;
+        }
+    }
+
+    // invalidates all non-global entries of the given address space
+    void flush_asid(HalfWord asid) noexcept
+    {
+        for (auto &level : entries_)
+            for (auto &entry : level)
+                if (entry.asid == asid && !entry.global)
+                    entry.prefix = kInvalidPrefix;
+    }
+
+    // the number of walks started at a table of the given level
+    counter_type hits(std::size_t level) const noexcept { return hits_[level]; }
+    // the number of walks started at the root
+    counter_type misses() const noexcept { return misses_; }
+
+private:
+
+    // prefixes are at most 43 bits wide, so this value never matches a real one
+    static constexpr DoubleWord kInvalidPrefix = ~DoubleWord{0};
+
+    static DoubleWord get_prefix(DoubleWord va, Byte level) noexcept
+    {
+        return va >> (kPageBits + 9 * (level + 1));
+    }
+
+    struct Entry final
+    {
+        DoubleWord prefix;
+        DoubleWord pa = 0;
+        HalfWord asid = 0;
+        bool global = false;
+    };
+
+    std::array<std::array<Entry, kSize>, kNLevels> entries_;
+
+    std::array<counter_type, kNLevels> hits_{};
+    counter_type misses_ = 0;
+};
+
+} // namespace yarvs
+
+#endif // INCLUDE_MEMORY_WALK_CACHE_HPP
@@ -0,0 +1,100 @@
+#ifndef INCLUDE_PREDECODED_CODE_HPP
+#define INCLUDE_PREDECODED_CODE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "yarvs/common.hpp"
+#include "yarvs/instruction.hpp"
+#include "yarvs/instruction_buffer.hpp"
+
+#include "yarvs/memory/memory.hpp"
+
+namespace yarvs
+{
+
+/*
+ * Executable segments of a program decoded at load time: every 4-byte slot holds a decoded
+ * instruction, so the first execution of the code costs an array lookup instead of fetch and
+ * decode. Starts of basic blocks reachable from the entry point are recovered by following direct
+ * jumps and branches statically; indirect jumps are not followed.
+ *
+ * Instructions are looked up by the physical address of a fetch: fetches are translated as usual,
+ * so that permissions are checked and page faults are raised, and the predecoded instruction
+ * replaces decoding of the fetched one. Pages whose memory has been written are dropped, after
+ * which their code is decoded as usual.
+ */
+class PredecodedCode final
+{
+public:
+
+    bool empty() const noexcept { return segments_.empty(); }
+
+    // the segment [va, va + code.size()) is loaded at physical address pa; va shall be aligned
+    void add_segment(DoubleWord va, DoubleWord pa, std::span<const Byte> code);
+
+    // shall be called after all the segments are added
+    void recover_cfg(DoubleWord entry);
+
+    // returns std::nullopt if the instruction at physical address pa hasn't been predecoded
+    std::optional<Instruction> find(DoubleWord pa) const noexcept
+    {
+        for (const auto &segment : segments_)
+        {
+            const DoubleWord offset = pa - segment.pa();
+            if (offset >= segment.instrs.size() * sizeof(RawInstruction))
+                continue;
+
+            const auto page = (segment.va % Memory::kPageSize + offset) / Memory::kPageSize;
+            if (!segment.valid_pages[page]) [[unlikely]]
+                return std::nullopt;
+            return segment.instrs[offset / sizeof(RawInstruction)];
+        }
+        return std::nullopt;
+    }
+
+    /*
+     * The number of instructions of the basic block starting at va up to its terminator or the
+     * start of the next block. It's 0 if no block starting at va has been found.
+     */
+    std::size_t block_size(DoubleWord va) const noexcept;
+
+    void invalidate_pages(std::span<const DoubleWord> ppns) noexcept;
+    void clear() noexcept { segments_.clear(); }
+
+    std::size_t n_blocks() const noexcept;
+
+private:
+
+    struct Segment final
+    {
+        DoubleWord va;
+        DoubleWord first_ppn; // the segment is contiguous in physical memory
+        InstructionBuffer instrs;
+        std::vector<bool> leaders; // instructions starting basic blocks
+        std::vector<bool> valid_pages;
+
+        DoubleWord pa() const noexcept
+        {
+            return first_ppn * Memory::kPageSize + va % Memory::kPageSize;
+        }
+    };
+
+    // returns nullptr if va is not in any segment
+    const Segment *segment_of(DoubleWord va) const noexcept;
+
+    Segment *segment_of(DoubleWord va) noexcept
+    {
+        return const_cast<Segment *>(std::as_const(*this).segment_of(va));
+    }
+
+    std::vector<Segment> segments_;
+};
+
+} // namespace yarvs
+
+#endif // INCLUDE_PREDECODED_CODE_HPP
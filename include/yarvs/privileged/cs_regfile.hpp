@@ -3,6 +3,7 @@
 
 #include <array>
 #include <cassert>
+#include <cstddef>
 #include <utility>
 
 #include "yarvs/bits_manipulation.hpp"
@@ -21,32 +22,45 @@
 namespace yarvs
 {
 
+// the implemented CSRs: X(enumerator, address, name)
+#define YARVS_CSRS(X)                 \
+    X(kSStatus, 0x100, "sstatus")     \
+    X(kSTVec, 0x105, "stvec")         \
+    X(kSScratch, 0x140, "sscratch")   \
+    X(kSEPC, 0x141, "sepc")           \
+    X(kSCause, 0x142, "scause")       \
+    X(kSTVal, 0x143, "stval")         \
+    X(kSATP, 0x180, "satp")           \
+    X(kMStatus, 0x300, "mstatus")     \
+    X(kMISA, 0x301, "misa")           \
+    X(kMEDeleg, 0x302, "medeleg")     \
+    X(kMTVec, 0x305, "mtvec")         \
+    X(kMScratch, 0x340, "mscratch")   \
+    X(kMEPC, 0x341, "mepc")           \
+    X(kMCause, 0x342, "mcause")       \
+    X(kMTVal, 0x343, "mtval")
+
 class CSRegFile final
 {
 public:
 
     enum CSR : DoubleWord
     {
-        kSStatus = 0x100,
-        kSTVec = 0x105,
-        kSScratch = 0x140,
-        kSEPC = 0x141,
-        kSCause = 0x142,
-        kSTVal = 0x143,
-        kSATP = 0x180,
-
-        kMStatus = 0x300,
-        kMISA = 0x301,
-        kMEDeleg = 0x302,
-        kMTVec = 0x305,
-        kMScratch = 0x340,
-        kMEPC = 0x341,
-        kMCause = 0x342,
-        kMTVal = 0x343
+#define YARVS_CSR_ENUMERATOR(id, address, str) id = address,
+        YARVS_CSRS(YARVS_CSR_ENUMERATOR)
+#undef YARVS_CSR_ENUMERATOR
     };
 
+    // the address space of CSRs
     static constexpr std::size_t kNRegs = 4096;
 
+    // stored in the order of YARVS_CSRS: registers out of it are not implemented
+    static constexpr std::array kImplemented = {
+#define YARVS_CSR_ELEMENT(id, address, str) id,
+        YARVS_CSRS(YARVS_CSR_ELEMENT)
+#undef YARVS_CSR_ELEMENT
+    };
+
     CSRegFile() = default;
 
     CSRegFile(const CSRegFile &rhs) = delete;
@@ -55,16 +69,19 @@ public:
     CSRegFile(CSRegFile &&rhs) = delete;
     CSRegFile &operator=(CSRegFile &&rhs) = delete;
 
+    // registers that are not implemented read as 0
     DoubleWord get_reg(std::size_t i) const noexcept
     {
         assert(i < kNRegs);
-        return csrs_[i];
+        return csrs_[kIndices[i]];
     }
 
+    // writes to registers that are not implemented are ignored without a branch
     void set_reg(std::size_t i, DoubleWord csr) noexcept
     {
         assert(i < kNRegs);
-        csrs_[i] = csr;
+        const auto index = kIndices[i];
+        csrs_[index] = (index != kZero) ? csr : 0;
     }
 
     static auto get_lowest_privilege_level(std::size_t i) noexcept
@@ -109,6 +126,9 @@ public:
     void set_satp(DoubleWord v) noexcept { set_reg(kSATP, v); }
     bool is_satp_active(PrivilegeLevel current_level) const noexcept
     {
+        if constexpr (kUserISA) // MPRV is never set
+            return current_level != PrivilegeLevel::kMachine;
+
         const auto mstatus = get_mstatus();
         const auto effective_priv_mode = mstatus.get_mprv() ? mstatus.get_mpp() : current_level;
         return effective_priv_mode != PrivilegeLevel::kMachine;
@@ -152,36 +172,11 @@ public:
     {
         switch (csr)
         {
-            case kSStatus:
-                return "sstatus";
-            case kSTVec:
-                return "stvec";
-            case kSScratch:
-                return "sscratch";
-            case kSEPC:
-                return "sepc";
-            case kSCause:
-                return "scause";
-            case kSTVal:
-                return "stval";
-            case kSATP:
-                return "satp";
-            case kMStatus:
-                return "mstatus";
-            case kMISA:
-                return "misa";
-            case kMEDeleg:
-                return "medeleg";
-            case kMTVec:
-                return "mtvec";
-            case kMScratch:
-                return "mscratch";
-            case kMEPC:
-                return "mepc";
-            case kMCause:
-                return "mcause";
-            case kMTVal:
-                return "mtval";
+#define YARVS_CSR_CASE(id, address, str) \
+            case id:                      \
+                return str;
+            YARVS_CSRS(YARVS_CSR_CASE)
+#undef YARVS_CSR_CASE
             default:
                 std::unreachable();
         }
@@ -189,9 +184,35 @@ public:
 
 private:
 
-    std::array<DoubleWord, kNRegs> csrs_{};
+    using index_type = Byte;
+
+    static constexpr index_type kZero = kImplemented.size(); // the slot that is always 0
+
+    // maps the address of a CSR to its slot in csrs_
+    static constexpr std::array<index_type, kNRegs> kIndices = []
+    {
+        std::array<index_type, kNRegs> indices;
+        indices.fill(kZero);
+        for (std::size_t i = 0; i != kImplemented.size(); ++i)
+            indices[kImplemented[i]] = static_cast<index_type>(i);
+        return indices;
+    }();
+
+    // only the implemented registers are stored
+    std::array<DoubleWord, kImplemented.size() + 1> csrs_{};
+
+    // each CSR has a slot of its own: one that shared it would read what the other writes
+    static_assert([]
+    {
+        for (std::size_t i = 0; i != kImplemented.size(); ++i)
+            if (kIndices[kImplemented[i]] != i)
+                return false;
+        return true;
+    }());
 };
 
+#undef YARVS_CSRS
+
 } // namespace yarvs
 
 #endif // INCLUDE_PRIVILEGED_CS_REGFILE_HPP
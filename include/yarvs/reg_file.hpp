@@ -4,6 +4,7 @@
 #include <array>
 #include <cassert>
 #include <cstddef>
+#include <iterator>
 
 #include "yarvs/common.hpp"
 
@@ -26,36 +27,40 @@ public:
         return gprs_[i];
     }
 
+    // writes to x0 go to a sink register, which is selected without a branch
     void set_reg(std::size_t i, reg_type new_value) noexcept
     {
-        if (i != 0)
-        {
-            assert(i < 32);
-            gprs_[i] = new_value;
-        }
+        assert(i < kNRegs);
+        gprs_[i != 0 ? i : kSink] = new_value;
     }
 
     void clear() { gprs_.fill(0); }
 
+    // x0 shall not be written through the pointer
+    reg_type *data() noexcept { return gprs_.data(); }
+    const reg_type *data() const noexcept { return gprs_.data(); }
+
     auto begin() noexcept { return gprs_.begin(); }
     auto begin() const noexcept { return gprs_.begin(); }
     auto cbegin() const noexcept { return begin(); }
 
-    auto end() noexcept { return gprs_.end(); }
-    auto end() const noexcept { return gprs_.end(); }
+    auto end() noexcept { return gprs_.begin() + kNRegs; }
+    auto end() const noexcept { return gprs_.begin() + kNRegs; }
     auto cend() const noexcept { return end(); }
 
-    auto rbegin() noexcept { return gprs_.rbegin(); }
-    auto rbegin() const noexcept { return gprs_.rbegin(); }
+    auto rbegin() noexcept { return std::make_reverse_iterator(end()); }
+    auto rbegin() const noexcept { return std::make_reverse_iterator(end()); }
     auto crbegin() const noexcept { return rbegin(); }
 
-    auto rend() noexcept { return gprs_.rend(); }
-    auto rend() const noexcept { return gprs_.rend(); }
+    auto rend() noexcept { return std::make_reverse_iterator(begin()); }
+    auto rend() const noexcept { return std::make_reverse_iterator(begin()); }
     auto crend() const noexcept { return rend(); }
 
 private:
 
-    std::array<reg_type, kNRegs> gprs_{};
+    static constexpr std::size_t kSink = kNRegs;
+
+    std::array<reg_type, kNRegs + 1> gprs_{}; // x0-x31 and the sink
 };
 
 } // namespace yarvs
@@ -0,0 +1,234 @@
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define YARVS_BULK_DECODER_AVX2
+#include <immintrin.h>
+#endif
+
+#include "yarvs/common.hpp"
+#include "yarvs/decoder.hpp"
+#include "yarvs/identifiers.hpp"
+#include "yarvs/instruction_buffer.hpp"
+
+namespace yarvs
+{
+
+void Decoder::decode_bulk(std::span<const RawInstruction> raw_instrs, InstructionBuffer &buffer)
+{
+    const auto first = buffer.size();
+    buffer.resize(first + raw_instrs.size());
+
+    std::size_t n_decoded = 0;
+#ifdef YARVS_BULK_DECODER_AVX2
+    static const bool kHasAVX2 = __builtin_cpu_supports("avx2");
+    if (kHasAVX2)
+        n_decoded = decode_bulk_avx2(raw_instrs, buffer, first);
+#endif
+
+    for (auto i = n_decoded; i != raw_instrs.size(); ++i)
+        buffer.set(first + i, decode(raw_instrs[i]));
+}
+
+#ifdef YARVS_BULK_DECODER_AVX2
+
+namespace
+{
+
+[[gnu::target("avx2")]] inline __m256i splat(std::int32_t value) noexcept
+{
+    return _mm256_set1_epi32(value);
+}
+
+// bits [kLSB + 4 : kLSB] of every lane, or 0 in lanes where present is 0
+template<int kLSB>
+[[gnu::target("avx2")]] inline __m256i register_field(__m256i raw, __m256i present) noexcept
+{
+    return _mm256_and_si256(_mm256_and_si256(_mm256_srli_epi32(raw, kLSB), splat(0x1f)), present);
+}
+
+// dwords at base[index + offset], where index and offset are in dwords
+[[gnu::target("avx2")]] inline __m256i gather(const int *base, __m256i index,
+                                              std::int32_t offset) noexcept
+{
+    return _mm256_i32gather_epi32(base, _mm256_add_epi32(index, splat(offset)), 4);
+}
+
+// all ones in lanes having the bits of flag set in flags
+[[gnu::target("avx2")]] inline __m256i has_flag(__m256i flags, std::int32_t flag) noexcept
+{
+    return _mm256_cmpeq_epi32(_mm256_and_si256(flags, splat(flag)), splat(flag));
+}
+
+// values in lanes where keys are equal to key, zeros in others
+[[gnu::target("avx2")]] inline __m256i select(__m256i keys, std::int32_t key,
+                                              __m256i values) noexcept
+{
+    return _mm256_and_si256(values, _mm256_cmpeq_epi32(keys, splat(key)));
+}
+
+// the low bytes of 8 lanes
+[[gnu::target("avx2")]] inline void store_bytes(Byte *dst, __m256i lanes) noexcept
+{
+    const auto shuffle = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                          -1, 0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                          -1, -1);
+    const auto packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(lanes, shuffle),
+                                                    _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0));
+    _mm_storel_epi64(reinterpret_cast<__m128i *>(dst), _mm256_castsi256_si128(packed));
+}
+
+} // unnamed namespace
+
+/*
+ * The lookup of decode is done for 8 instructions at a time with gathers from the same tables. All
+ * the immediate formats are computed for every lane, and the one the instruction uses is selected
+ * by its format.
+ */
+[[gnu::target("avx2")]]
+std::size_t Decoder::decode_bulk_avx2(std::span<const RawInstruction> raw_instrs,
+                                      InstructionBuffer &buffer, std::size_t first) noexcept
+{
+    static_assert(sizeof(RawInstruction) == sizeof(std::int32_t));
+    static_assert(sizeof(InstrID) == sizeof(Byte));
+    static_assert(sizeof(Instruction::handler_type) == sizeof(long long));
+    static_assert(sizeof(Instruction::immediate_type) == sizeof(std::int32_t));
+
+    // the group is read as 2 dwords: offset and mask at byte 0, mask and shift at byte 2
+    static_assert(sizeof(Group) == 6);
+    static_assert(offsetof(Group, offset) == 0 && offsetof(Group, mask) == 2);
+    static_assert(offsetof(Group, shift) == 4);
+
+    static_assert(sizeof(Entry) % sizeof(std::int32_t) == 0);
+    static_assert(offsetof(Entry, mask) % sizeof(std::int32_t) == 0);
+    static_assert(offsetof(Entry, match) % sizeof(std::int32_t) == 0);
+    static_assert(offsetof(Entry, id) % sizeof(std::int32_t) == 0); // followed by padding
+
+    // operands and the immediate format are read as a dword
+    static_assert(sizeof(Format) % sizeof(long long) == 0);
+    static_assert(offsetof(Format, handlers) == 0);
+    static_assert(offsetof(Format, imm) == offsetof(Format, operands) + 1);
+    static_assert(offsetof(Format, operands) % sizeof(std::int32_t) == 0);
+
+    constexpr std::size_t kLanes = 8;
+    constexpr std::int32_t kDWord = sizeof(std::int32_t);
+    constexpr std::int32_t kGroupSize = sizeof(Group);
+    constexpr std::int32_t kEntryDWords = sizeof(Entry) / kDWord;
+    constexpr std::int32_t kFormatDWords = sizeof(Format) / kDWord;
+    constexpr std::int32_t kFormatQWords = sizeof(Format) / sizeof(long long);
+
+    constexpr auto kI = static_cast<std::int32_t>(ImmFormat::kI);
+    constexpr auto kS = static_cast<std::int32_t>(ImmFormat::kS);
+    constexpr auto kB = static_cast<std::int32_t>(ImmFormat::kB);
+    constexpr auto kU = static_cast<std::int32_t>(ImmFormat::kU);
+    constexpr auto kJ = static_cast<std::int32_t>(ImmFormat::kJ);
+    constexpr auto kZeroExtendedI = static_cast<std::int32_t>(ImmFormat::kZeroExtendedI);
+    constexpr auto kRaw = static_cast<std::int32_t>(ImmFormat::kRaw);
+
+    const auto *groups = reinterpret_cast<const int *>(kGroups.data());
+    const auto *entries = reinterpret_cast<const int *>(kEntries);
+    const auto *formats = reinterpret_cast<const int *>(kFormats.data());
+    const auto *handlers = reinterpret_cast<const long long *>(kFormats.data());
+
+    auto handler_dst = buffer.handlers().subspan(first);
+    auto id_dst = buffer.ids().subspan(first);
+    auto rs1_dst = buffer.rs1s().subspan(first);
+    auto rs2_dst = buffer.rs2s().subspan(first);
+    auto rd_dst = buffer.rds().subspan(first);
+    auto imm_dst = buffer.imms().subspan(first);
+
+    std::size_t i = 0;
+    for (; i + kLanes <= raw_instrs.size(); i += kLanes)
+    {
+        const auto raw = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&raw_instrs[i]));
+
+        // look up the entries (see decode)
+        const auto group_index = _mm256_or_si256(
+            _mm256_and_si256(_mm256_srli_epi32(raw, 2), splat(0x1f)),
+            _mm256_and_si256(_mm256_srli_epi32(raw, 7), splat(0xe0)));
+        const auto group_pos = _mm256_mullo_epi32(group_index, splat(kGroupSize));
+        const auto offset_mask = _mm256_i32gather_epi32(groups, group_pos, 1);
+        const auto mask_shift = _mm256_i32gather_epi32(groups,
+                                                       _mm256_add_epi32(group_pos, splat(2)), 1);
+
+        const auto slice = _mm256_and_si256(
+            _mm256_srlv_epi32(raw, _mm256_and_si256(_mm256_srli_epi32(mask_shift, 16),
+                                                    splat(0xff))),
+            _mm256_and_si256(mask_shift, splat(0xffff)));
+        const auto entry_pos = _mm256_mullo_epi32(
+            _mm256_add_epi32(_mm256_and_si256(offset_mask, splat(0xffff)), slice),
+            splat(kEntryDWords));
+
+        const auto mask = gather(entries, entry_pos, offsetof(Entry, mask) / kDWord);
+        const auto match = gather(entries, entry_pos, offsetof(Entry, match) / kDWord);
+        const auto valid = _mm256_cmpeq_epi32(_mm256_and_si256(raw, mask), match);
+        const auto entry_id = _mm256_and_si256(
+            gather(entries, entry_pos, offsetof(Entry, id) / kDWord), splat(0xff));
+        const auto id = _mm256_blendv_epi8(splat(InstrID::kILLEGAL), entry_id, valid);
+
+        // operands in the low byte, the immediate format in the next one
+        const auto format = gather(formats, _mm256_mullo_epi32(id, splat(kFormatDWords)),
+                                   offsetof(Format, operands) / kDWord);
+
+        // immediates of all the formats
+        const auto i_imm = _mm256_srai_epi32(raw, 20);
+        const auto s_imm = _mm256_or_si256(_mm256_and_si256(i_imm, splat(~0x1f)),
+                                           _mm256_and_si256(_mm256_srli_epi32(raw, 7),
+                                                            splat(0x1f)));
+        const auto b_imm = _mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(_mm256_srai_epi32(raw, 19), splat(~0xfff)),
+                            _mm256_and_si256(_mm256_slli_epi32(raw, 4), splat(0x800))),
+            _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(raw, 20), splat(0x7e0)),
+                            _mm256_and_si256(_mm256_srli_epi32(raw, 7), splat(0x1e))));
+        const auto u_imm = _mm256_and_si256(raw, splat(~0xfff));
+        const auto j_imm = _mm256_or_si256(
+            _mm256_or_si256(_mm256_and_si256(_mm256_srai_epi32(raw, 11), splat(~0xfffff)),
+                            _mm256_and_si256(raw, splat(0xff000))),
+            _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(raw, 9), splat(0x800)),
+                            _mm256_and_si256(_mm256_srli_epi32(raw, 20), splat(0x7fe))));
+        const auto zext_i_imm = _mm256_srli_epi32(raw, 20);
+
+        const auto imm_format = _mm256_and_si256(_mm256_srli_epi32(format, 8), splat(0xff));
+        const auto imm = _mm256_or_si256(
+            _mm256_or_si256(_mm256_or_si256(select(imm_format, kI, i_imm),
+                                            select(imm_format, kS, s_imm)),
+                            _mm256_or_si256(select(imm_format, kB, b_imm),
+                                            select(imm_format, kU, u_imm))),
+            _mm256_or_si256(_mm256_or_si256(select(imm_format, kJ, j_imm),
+                                            select(imm_format, kZeroExtendedI, zext_i_imm)),
+                            select(imm_format, kRaw, raw)));
+
+        const auto rs1 = register_field<15>(raw, has_flag(format, kRS1));
+        const auto rs2 = register_field<20>(raw, has_flag(format, kRS2));
+        const auto rd = register_field<7>(raw, has_flag(format, kRD));
+
+        /*
+         * A missing operand reads as x0 here. Formats of instructions without a special form
+         * repeat the general handler, so that the form doesn't matter for them.
+         */
+        const auto form = _mm256_blendv_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi32(rs1, _mm256_setzero_si256()), splat(kRS1X0)),
+            splat(kRDX0), _mm256_cmpeq_epi32(rd, _mm256_setzero_si256()));
+
+        // handlers are 8-byte long: they are gathered in two halves
+        const auto handler_pos = _mm256_add_epi32(_mm256_mullo_epi32(id, splat(kFormatQWords)),
+                                                  form);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&handler_dst[i]),
+            _mm256_i32gather_epi64(handlers, _mm256_castsi256_si128(handler_pos), 8));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&handler_dst[i + kLanes / 2]),
+            _mm256_i32gather_epi64(handlers, _mm256_extracti128_si256(handler_pos, 1), 8));
+        store_bytes(reinterpret_cast<Byte *>(&id_dst[i]), id);
+        store_bytes(&rs1_dst[i], rs1);
+        store_bytes(&rs2_dst[i], rs2);
+        store_bytes(&rd_dst[i], rd);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(&imm_dst[i]), imm);
+    }
+
+    return i;
+}
+
+#endif // YARVS_BULK_DECODER_AVX2
+
+} // namespace yarvs
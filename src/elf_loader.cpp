@@ -82,6 +82,7 @@ ELFLoader::Segment ELFLoader::segment(std::size_t i) const
                    .memory_size = segment->get_memory_size(),
                    .file_size = segment->get_file_size(),
                    .virtual_address = segment->get_virtual_address(),
+                   .flags = SegmentFlags{segment->get_flags()},
                    .loadable = segment->get_type() == ELFIO::PT_LOAD};
 }
 
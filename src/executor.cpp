@@ -1,4 +1,5 @@
 #include <functional>
+#include <optional>
 #include <stdexcept>
 
 #include <unistd.h>
@@ -7,6 +8,7 @@
 
 #include "yarvs/bits_manipulation.hpp"
 #include "yarvs/common.hpp"
+#include "yarvs/decoder.hpp"
 #include "yarvs/hart.hpp"
 #include "yarvs/instruction.hpp"
 
@@ -20,37 +22,37 @@ namespace yarvs
 bool Hart::exec_add(Hart &h, const Instruction &instr)
 {
     h.exec_rvi_reg_reg(instr, std::plus{});
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_sub(Hart &h, const Instruction &instr)
 {
     h.exec_rvi_reg_reg(instr, std::minus{});
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_and(Hart &h, const Instruction &instr)
 {
     h.exec_rvi_reg_reg(instr, std::bit_and{});
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_xor(Hart &h, const Instruction &instr)
 {
     h.exec_rvi_reg_reg(instr, std::bit_xor{});
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_or(Hart &h, const Instruction &instr)
 {
     h.exec_rvi_reg_reg(instr, std::bit_or{});
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_sltu(Hart &h, const Instruction &instr)
 {
     h.exec_rvi_reg_reg(instr, std::less{});
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_slt(Hart &h, const Instruction &instr)
@@ -59,7 +61,7 @@ bool Hart::exec_slt(Hart &h, const Instruction &instr)
     {
         return to_signed(lhs) < to_signed(rhs);
     });
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 // RVI64 integer register-register operations
@@ -67,13 +69,13 @@ bool Hart::exec_slt(Hart &h, const Instruction &instr)
 bool Hart::exec_addw(Hart &h, const Instruction &instr)
 {
     h.exec_rv64i_reg_reg(instr, std::plus{});
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_subw(Hart &h, const Instruction &instr)
 {
     h.exec_rv64i_reg_reg(instr, std::minus{});
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_sll(Hart &h, const Instruction &instr)
@@ -82,7 +84,7 @@ bool Hart::exec_sll(Hart &h, const Instruction &instr)
     {
         return lhs << mask_bits<5, 0>(rhs);
     });
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_srl(Hart &h, const Instruction &instr)
@@ -91,7 +93,7 @@ bool Hart::exec_srl(Hart &h, const Instruction &instr)
     {
         return lhs >> mask_bits<5, 0>(rhs);
     });
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_sra(Hart &h, const Instruction &instr)
@@ -100,7 +102,7 @@ bool Hart::exec_sra(Hart &h, const Instruction &instr)
     {
         return to_unsigned(to_signed(lhs) >> mask_bits<5, 0>(rhs));
     });
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_sllw(Hart &h, const Instruction &instr)
@@ -109,25 +111,25 @@ bool Hart::exec_sllw(Hart &h, const Instruction &instr)
     {
         return lhs << mask_bits<4, 0>(rhs);
     });
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_srlw(Hart &h, const Instruction &instr)
 {
     h.exec_rv64i_reg_reg(instr, [](auto lhs, auto rhs)
     {
-        return lhs >> mask_bits<4, 0>(rhs);
+        return static_cast<Word>(lhs) >> mask_bits<4, 0>(rhs);
     });
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_sraw(Hart &h, const Instruction &instr)
 {
     h.exec_rv64i_reg_reg(instr, [](auto lhs, auto rhs)
     {
-        return to_signed(lhs) >> mask_bits<4, 0>(rhs);
+        return to_signed(static_cast<Word>(lhs)) >> mask_bits<4, 0>(rhs);
     });
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 // RVI integer register-immediate instructions
@@ -135,31 +137,31 @@ bool Hart::exec_sraw(Hart &h, const Instruction &instr)
 bool Hart::exec_addi(Hart &h, const Instruction &instr)
 {
     h.exec_rvi_reg_imm(instr, std::plus{});
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_andi(Hart &h, const Instruction &instr)
 {
     h.exec_rvi_reg_imm(instr, std::bit_and{});
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_ori(Hart &h, const Instruction &instr)
 {
     h.exec_rvi_reg_imm(instr, std::bit_or{});
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_xori(Hart &h, const Instruction &instr)
 {
     h.exec_rvi_reg_imm(instr, std::bit_xor{});
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_sltiu(Hart &h, const Instruction &instr)
 {
     h.exec_rvi_reg_imm(instr, std::less{});
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_slti(Hart &h, const Instruction &instr)
@@ -168,21 +170,21 @@ bool Hart::exec_slti(Hart &h, const Instruction &instr)
     {
         return to_signed(lhs) < to_signed(rhs);
     });
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_lui(Hart &h, const Instruction &instr)
 {
     h.gprs_.set_reg(instr.rd, instr.imm);
     h.pc_ += sizeof(RawInstruction);
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_auipc(Hart &h, const Instruction &instr)
 {
     h.gprs_.set_reg(instr.rd, h.pc_ + instr.imm);
     h.pc_ += sizeof(RawInstruction);
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 // RV64I integer register-immediate instructions
@@ -190,7 +192,7 @@ bool Hart::exec_auipc(Hart &h, const Instruction &instr)
 bool Hart::exec_addiw(Hart &h, const Instruction &instr)
 {
     h.exec_rv64i_reg_imm(instr, std::plus{});
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_slli(Hart &h, const Instruction &instr)
@@ -199,7 +201,7 @@ bool Hart::exec_slli(Hart &h, const Instruction &instr)
     {
         return lhs << mask_bits<5, 0>(rhs);
     });
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_srli(Hart &h, const Instruction &instr)
@@ -208,7 +210,7 @@ bool Hart::exec_srli(Hart &h, const Instruction &instr)
     {
         return lhs >> mask_bits<5, 0>(rhs);
     });
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_srai(Hart &h, const Instruction &instr)
@@ -217,7 +219,7 @@ bool Hart::exec_srai(Hart &h, const Instruction &instr)
     {
         return to_unsigned(to_signed(lhs) >> mask_bits<5, 0>(rhs));
     });
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_slliw(Hart &h, const Instruction &instr)
@@ -226,25 +228,25 @@ bool Hart::exec_slliw(Hart &h, const Instruction &instr)
     {
         return lhs << mask_bits<5, 0>(rhs);
     });
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_srliw(Hart &h, const Instruction &instr)
 {
     h.exec_rv64i_reg_imm(instr, [](auto lhs, auto rhs)
     {
-        return lhs >> mask_bits<5, 0>(rhs);
+        return static_cast<Word>(lhs) >> mask_bits<4, 0>(rhs);
     });
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_sraiw(Hart &h, const Instruction &instr)
 {
     h.exec_rv64i_reg_imm(instr, [](auto lhs, auto rhs)
     {
-        return to_signed(lhs) >> mask_bits<5, 0>(rhs);
+        return to_signed(static_cast<Word>(lhs)) >> mask_bits<4, 0>(rhs);
     });
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 // RVI control transfer instructions
@@ -253,26 +255,27 @@ bool Hart::exec_jal(Hart &h, const Instruction &instr)
 {
     h.gprs_.set_reg(instr.rd, h.pc_ + sizeof(RawInstruction));
     h.pc_ += instr.imm;
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_jalr(Hart &h, const Instruction &instr)
 {
+    const auto target = (h.gprs_.get_reg(instr.rs1) + instr.imm) & ~DoubleWord{1}; // rd may be rs1
     h.gprs_.set_reg(instr.rd, h.pc_ + sizeof(RawInstruction));
-    h.pc_ = (h.gprs_.get_reg(instr.rs1) + instr.imm) & ~DoubleWord{1};
-    return true;
+    h.pc_ = target;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_beq(Hart &h, const Instruction &instr)
 {
     h.exec_cond_branch(instr, std::equal_to{});
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_bne(Hart &h, const Instruction &instr)
 {
     h.exec_cond_branch(instr, std::not_equal_to{});
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_blt(Hart &h, const Instruction &instr)
@@ -281,13 +284,13 @@ bool Hart::exec_blt(Hart &h, const Instruction &instr)
     {
         return to_signed(lhs) < to_signed(rhs);
     });
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_bltu(Hart &h, const Instruction &instr)
 {
     h.exec_cond_branch(instr, std::less{});
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_bge(Hart &h, const Instruction &instr)
@@ -296,41 +299,114 @@ bool Hart::exec_bge(Hart &h, const Instruction &instr)
     {
         return to_signed(lhs) >= to_signed(rhs);
     });
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_bgeu(Hart &h, const Instruction &instr)
 {
     h.exec_cond_branch(instr, std::greater_equal{});
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 // RV64I load and store instructions
 
-bool Hart::exec_ld(Hart &h, const Instruction &instr) { return h.exec_load<DoubleWord>(instr); }
-bool Hart::exec_lw(Hart &h, const Instruction &instr) { return h.exec_load<Word>(instr); }
-bool Hart::exec_lh(Hart &h, const Instruction &instr) { return h.exec_load<HalfWord>(instr); }
-bool Hart::exec_lb(Hart &h, const Instruction &instr) { return h.exec_load<Byte>(instr); }
+bool Hart::exec_ld(Hart &h, const Instruction &instr)
+{
+    if (!h.exec_load<DoubleWord>(instr)) [[unlikely]]
+        return false;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+bool Hart::exec_lw(Hart &h, const Instruction &instr)
+{
+    if (!h.exec_load<Word>(instr)) [[unlikely]]
+        return false;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
 
-bool Hart::exec_lwu(Hart &h, const Instruction &instr) { return h.exec_uload<Word>(instr); }
-bool Hart::exec_lhu(Hart &h, const Instruction &instr) { return h.exec_uload<HalfWord>(instr); }
-bool Hart::exec_lbu(Hart &h, const Instruction &instr) { return h.exec_uload<Byte>(instr); }
+bool Hart::exec_lh(Hart &h, const Instruction &instr)
+{
+    if (!h.exec_load<HalfWord>(instr)) [[unlikely]]
+        return false;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+bool Hart::exec_lb(Hart &h, const Instruction &instr)
+{
+    if (!h.exec_load<Byte>(instr)) [[unlikely]]
+        return false;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+bool Hart::exec_lwu(Hart &h, const Instruction &instr)
+{
+    if (!h.exec_uload<Word>(instr)) [[unlikely]]
+        return false;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
 
-bool Hart::exec_sd(Hart &h, const Instruction &instr) { return h.exec_store<DoubleWord>(instr); }
-bool Hart::exec_sw(Hart &h, const Instruction &instr) { return h.exec_store<Word>(instr); }
-bool Hart::exec_sh(Hart &h, const Instruction &instr) { return h.exec_store<HalfWord>(instr); }
-bool Hart::exec_sb(Hart &h, const Instruction &instr) { return h.exec_store<Byte>(instr); }
+bool Hart::exec_lhu(Hart &h, const Instruction &instr)
+{
+    if (!h.exec_uload<HalfWord>(instr)) [[unlikely]]
+        return false;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+bool Hart::exec_lbu(Hart &h, const Instruction &instr)
+{
+    if (!h.exec_uload<Byte>(instr)) [[unlikely]]
+        return false;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+bool Hart::exec_sd(Hart &h, const Instruction &instr)
+{
+    if (!h.exec_store<DoubleWord>(instr)) [[unlikely]]
+        return false;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+bool Hart::exec_sw(Hart &h, const Instruction &instr)
+{
+    if (!h.exec_store<Word>(instr)) [[unlikely]]
+        return false;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+bool Hart::exec_sh(Hart &h, const Instruction &instr)
+{
+    if (!h.exec_store<HalfWord>(instr)) [[unlikely]]
+        return false;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+bool Hart::exec_sb(Hart &h, const Instruction &instr)
+{
+    if (!h.exec_store<Byte>(instr)) [[unlikely]]
+        return false;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
 
 // RVI memory ordering instructions
 
-bool Hart::exec_fence([[maybe_unused]] Hart &h, [[maybe_unused]] const Instruction &instr)
+bool Hart::exec_fence(Hart &h, const Instruction &instr)
+{
+    h.pc_ += sizeof(RawInstruction); // no-op for a single hart
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+// Zifencei
+
+bool Hart::exec_fence_i(Hart &h, const Instruction &instr)
 {
-    return true; // ignore
+    h.mem_.fence_i(); // cached code is invalidated after the block
+    h.pc_ += sizeof(RawInstruction);
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 // RVI environment call and breakpoints
 
-bool Hart::exec_ecall(Hart &h, [[maybe_unused]] const Instruction &instr)
+bool Hart::exec_ecall(Hart &h, const Instruction &instr)
 {
     switch (auto syscall_num = h.gprs_.get_reg(Hart::kSyscallNumReg))
     {
@@ -362,56 +438,70 @@ bool Hart::exec_ecall(Hart &h, [[maybe_unused]] const Instruction &instr)
                                                  syscall_num, h.pc_)};
     }
 
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
-bool Hart::exec_ebreak(Hart &h, [[maybe_unused]] const Instruction &instr)
+bool Hart::exec_ebreak(Hart &h, const Instruction &instr)
 {
     h.run_ = false;
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
+#ifndef YARVS_USER_ISA // the privileged architecture
+
 // Zicsr extension
 
 bool Hart::exec_csrrw(Hart &h, const Instruction &instr)
 {
-    return h.exec_csrrw_csrrwi(instr, [&gprs = h.gprs_](const Instruction &instr)
-    {
-        return gprs.get_reg(instr.rs1);
-    });
+    if (!h.exec_csrrw_csrrwi(instr, [&gprs = h.gprs_](const Instruction &instr)
+        {
+            return gprs.get_reg(instr.rs1);
+        })) [[unlikely]]
+        return false;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_csrrwi(Hart &h, const Instruction &instr)
 {
-    return h.exec_csrrw_csrrwi(instr, &Instruction::rs1);
+    if (!h.exec_csrrw_csrrwi(instr, &Instruction::rs1)) [[unlikely]]
+        return false;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_csrrs(Hart &h, const Instruction &instr)
 {
-    return h.exec_csrrs_csrrc(instr, std::bit_or{}, [&gprs = h.gprs_](const Instruction &instr)
-    {
-        return gprs.get_reg(instr.rs1);
-    });
+    if (!h.exec_csrrs_csrrc(instr, std::bit_or{}, [&gprs = h.gprs_](const Instruction &instr)
+        {
+            return gprs.get_reg(instr.rs1);
+        })) [[unlikely]]
+        return false;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_csrrc(Hart &h, const Instruction &instr)
 {
-    return h.exec_csrrs_csrrc(instr, [](auto lhs, auto rhs){ return lhs & ~rhs; },
-                              [&gprs = h.gprs_](const Instruction &instr)
-    {
-        return gprs.get_reg(instr.rs1);
-    });
+    if (!h.exec_csrrs_csrrc(instr, [](auto lhs, auto rhs){ return lhs & ~rhs; },
+                            [&gprs = h.gprs_](const Instruction &instr)
+        {
+            return gprs.get_reg(instr.rs1);
+        })) [[unlikely]]
+        return false;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_csrrsi(Hart &h, const Instruction &instr)
 {
-    return h.exec_csrrs_csrrc(instr, std::bit_or{}, &Instruction::rs1);
+    if (!h.exec_csrrs_csrrc(instr, std::bit_or{}, &Instruction::rs1)) [[unlikely]]
+        return false;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_csrrci(Hart &h, const Instruction &instr)
 {
-    return h.exec_csrrs_csrrc(instr, [](auto lhs, auto rhs){ return lhs & ~rhs; },
-                              &Instruction::rs1);
+    if (!h.exec_csrrs_csrrc(instr, [](auto lhs, auto rhs){ return lhs & ~rhs; },
+                            &Instruction::rs1)) [[unlikely]]
+        return false;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 // System instructions
@@ -434,8 +524,9 @@ bool Hart::exec_sret(Hart &h, const Instruction &instr)
     }
 
     h.pc_ = h.csrs_.get_sepc();
+    h.mem_.flush_tlb();
 
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_mret(Hart &h, const Instruction &instr)
@@ -448,8 +539,9 @@ bool Hart::exec_mret(Hart &h, const Instruction &instr)
     h.csrs_.set_mstatus(mstatus);
 
     h.pc_ = h.csrs_.get_mepc();
+    h.mem_.flush_tlb();
 
-    return true;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 bool Hart::exec_wfi(Hart &h, const Instruction &instr)
@@ -459,7 +551,145 @@ bool Hart::exec_wfi(Hart &h, const Instruction &instr)
 
 bool Hart::exec_sfence_vma(Hart &h, const Instruction &instr)
 {
-    throw std::runtime_error{"SFENCE.VMA is not implemented"};
+    if (h.priv_level_ == PrivilegeLevel::kUser) [[unlikely]]
+    {
+        h.raise_exception(MCause::kIllegalInstruction, instr.encode());
+        return false;
+    }
+
+    std::optional<DoubleWord> va;
+    if (instr.rs1 != 0)
+        va = h.gprs_.get_reg(instr.rs1);
+
+    std::optional<HalfWord> asid;
+    if (instr.rs2 != 0)
+        asid = static_cast<HalfWord>(h.gprs_.get_reg(instr.rs2));
+
+    h.mem_.sfence_vma(va, asid);
+
+    h.pc_ += sizeof(RawInstruction);
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+#endif // YARVS_USER_ISA
+
+// Encodings that are not valid instructions (see Decoder::decode)
+
+bool Hart::exec_illegal(Hart &h, const Instruction &instr)
+{
+    h.raise_exception(MCause::kIllegalInstruction, instr.encode());
+    return false;
+}
+
+// Forms of instructions with x0 operands selected on decoding
+
+// instructions whose only effect is writing x0
+bool Hart::exec_nop(Hart &h, const Instruction &instr)
+{
+    h.pc_ += sizeof(RawInstruction);
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+// addi, addiw, ori and xori with rs1 == x0: the result is the immediate itself
+bool Hart::exec_li(Hart &h, const Instruction &instr)
+{
+    h.gprs_.set_reg(instr.rd, DoubleWord(instr.imm));
+    h.pc_ += sizeof(RawInstruction);
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+// jal with rd == x0
+bool Hart::exec_j(Hart &h, const Instruction &instr)
+{
+    h.pc_ += instr.imm;
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+// jalr with rd == x0, such as ret
+bool Hart::exec_jr(Hart &h, const Instruction &instr)
+{
+    h.pc_ = (h.gprs_.get_reg(instr.rs1) + instr.imm) & ~DoubleWord{1};
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+// Fused pseudo-instructions (see Decoder::fuse)
+
+bool Hart::exec_lui_addi(Hart &h, const Instruction &instr)
+{
+    h.gprs_.set_reg(instr.rd, instr.imm);
+    h.pc_ += 2 * sizeof(RawInstruction);
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+bool Hart::exec_lui_addiw(Hart &h, const Instruction &instr)
+{
+    h.gprs_.set_reg(instr.rd, instr.imm);
+    h.pc_ += 2 * sizeof(RawInstruction);
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+bool Hart::exec_auipc_jalr(Hart &h, const Instruction &instr)
+{
+    const auto base = h.pc_ + Decoder::fused_auipc_imm(instr);
+    h.gprs_.set_reg(instr.rs1, base);
+    h.gprs_.set_reg(instr.rd, h.pc_ + 2 * sizeof(RawInstruction));
+    h.pc_ = (base + Decoder::fused_offset_imm(instr)) & ~DoubleWord{1};
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+bool Hart::exec_auipc_ld(Hart &h, const Instruction &instr)
+{
+    const auto base = h.pc_ + Decoder::fused_auipc_imm(instr);
+    h.gprs_.set_reg(instr.rs1, base);
+    h.pc_ += sizeof(RawInstruction); // auipc is complete: an exception is raised at ld
+
+    const auto va = base + Decoder::fused_offset_imm(instr);
+    auto maybe_value = h.mem_.load<DoubleWord>(va);
+    if (!maybe_value.has_value()) [[unlikely]]
+    {
+        h.raise_exception(maybe_value.error(), va);
+        return false;
+    }
+    h.gprs_.set_reg(instr.rd, *maybe_value);
+    h.pc_ += sizeof(RawInstruction);
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+bool Hart::exec_slli_srli(Hart &h, const Instruction &instr)
+{
+    h.gprs_.set_reg(instr.rd, (h.gprs_.get_reg(instr.rs1) << instr.imm) >> instr.imm);
+    h.pc_ += 2 * sizeof(RawInstruction);
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+bool Hart::exec_slt_bnez(Hart &h, const Instruction &instr)
+{
+    h.exec_fused_set_branch(instr, [](auto lhs, auto rhs)
+    {
+        return to_signed(lhs) < to_signed(rhs);
+    }, true);
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+bool Hart::exec_slt_beqz(Hart &h, const Instruction &instr)
+{
+    h.exec_fused_set_branch(instr, [](auto lhs, auto rhs)
+    {
+        return to_signed(lhs) < to_signed(rhs);
+    }, false);
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+bool Hart::exec_sltu_bnez(Hart &h, const Instruction &instr)
+{
+    h.exec_fused_set_branch(instr, std::less{}, true);
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
+}
+
+bool Hart::exec_sltu_beqz(Hart &h, const Instruction &instr)
+{
+    h.exec_fused_set_branch(instr, std::less{}, false);
+    YARVS_MUSTTAIL return dispatch_next(h, instr);
 }
 
 } // namespace yarvs
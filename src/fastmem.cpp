@@ -0,0 +1,166 @@
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <system_error>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "yarvs/common.hpp"
+
+#include "yarvs/memory/fastmem.hpp"
+
+namespace yarvs
+{
+
+namespace
+{
+
+// guest pages are mapped one by one, so the host shall have pages of the same size
+constexpr std::size_t kPageSize = 4096;
+
+Byte *page_of(Byte *addr) noexcept
+{
+    return reinterpret_cast<Byte *>(reinterpret_cast<std::uintptr_t>(addr) & ~(kPageSize - 1));
+}
+
+struct sigaction prev_action; // faults outside of the views are passed to it
+
+} // unnamed namespace
+
+std::array<std::atomic<FastMem *>, FastMem::kMaxViews> FastMem::views_{};
+
+FastMem::FastMem(int fd, std::size_t phys_mem_size, resolver_type resolver, void *context)
+    : fd_{fd}, phys_mem_size_{phys_mem_size}, resolver_{resolver}, context_{context}
+{
+    // mapping a guest page would fail in the signal handler, where it can only abort
+    if (sysconf(_SC_PAGESIZE) != static_cast<long>(kPageSize)) [[unlikely]]
+        throw std::runtime_error{"fastmem requires a host with 4KB pages"};
+
+    install_handler();
+
+    void *base = mmap(nullptr, kSize, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                      -1 /* fd */, 0 /* offset */);
+    if (base == MAP_FAILED) [[unlikely]]
+        throw std::system_error{errno, std::system_category(), "mmap() failed"};
+    base_ = static_cast<Byte *>(base);
+
+    for (auto &view : views_)
+    {
+        FastMem *expected = nullptr;
+        if (view.compare_exchange_strong(expected, this))
+            return;
+    }
+
+    munmap(base_, kSize);
+    throw std::runtime_error{"too many fastmem views"};
+}
+
+FastMem::~FastMem()
+{
+    for (auto &view : views_)
+    {
+        FastMem *expected = this;
+        view.compare_exchange_strong(expected, nullptr);
+    }
+    munmap(base_, kSize);
+}
+
+void FastMem::unmap_all() noexcept
+{
+    if (!populated_)
+        return;
+    reserve(base_, kSize);
+    populated_ = false;
+}
+
+void FastMem::unmap_page(DoubleWord va) noexcept
+{
+    const auto offset = to_offset(va);
+    if (populated_ && offset < kSize)
+        reserve(page_of(base_ + offset), kPageSize);
+}
+
+void FastMem::handle_fault(Byte *addr) noexcept
+{
+    Byte *page = page_of(addr);
+    const DoubleWord va = static_cast<DoubleWord>(addr - base_) - kSize / 2;
+
+    void *res;
+    const auto pa = resolver_(context_, va, write_);
+    if (pa.has_value() && *pa < phys_mem_size_)
+    {
+        const int prot = write_ ? PROT_READ | PROT_WRITE : PROT_READ;
+        res = mmap(page, kPageSize, prot, MAP_SHARED | MAP_FIXED, fd_, static_cast<off_t>(*pa));
+    }
+    else
+    {
+        res = mmap(page, kPageSize, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1 /* fd */, 0 /* offset */);
+        assert(n_scratch_pages_ < scratch_pages_.size());
+        scratch_pages_[n_scratch_pages_] = page;
+        n_scratch_pages_ = n_scratch_pages_ + 1;
+    }
+
+    if (res == MAP_FAILED) [[unlikely]] // returning would fault again
+        std::abort();
+    populated_ = true;
+}
+
+void FastMem::drop_scratch_pages() noexcept
+{
+    for (std::size_t i = 0; i != n_scratch_pages_; ++i)
+        reserve(scratch_pages_[i], kPageSize);
+    n_scratch_pages_ = 0;
+}
+
+void FastMem::reserve(Byte *addr, std::size_t size) noexcept
+{
+    [[maybe_unused]] void *res = mmap(addr, size, PROT_NONE,
+                                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+                                      -1 /* fd */, 0 /* offset */);
+    assert(res != MAP_FAILED);
+}
+
+void FastMem::install_handler()
+{
+    static const bool installed = []
+    {
+        struct sigaction action{};
+        action.sa_sigaction = &FastMem::handle_sigsegv;
+        action.sa_flags = SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(SIGSEGV, &action, &prev_action) == -1) [[unlikely]]
+            throw std::system_error{errno, std::system_category(), "sigaction() failed"};
+        return true;
+    }();
+    static_cast<void>(installed);
+}
+
+void FastMem::handle_sigsegv(int signo, siginfo_t *info, void *ucontext)
+{
+    auto *addr = static_cast<Byte *>(info->si_addr);
+    for (auto &view : views_)
+    {
+        if (FastMem *mem = view.load(std::memory_order_acquire); mem && mem->contains(addr))
+        {
+            mem->handle_fault(addr);
+            return;
+        }
+    }
+
+    if (prev_action.sa_flags & SA_SIGINFO)
+        prev_action.sa_sigaction(signo, info, ucontext);
+    else if (prev_action.sa_handler != SIG_DFL && prev_action.sa_handler != SIG_IGN)
+        prev_action.sa_handler(signo);
+    else // the faulting instruction is executed again with the previous action
+        sigaction(SIGSEGV, &prev_action, nullptr);
+}
+
+} // namespace yarvs
@@ -0,0 +1,131 @@
+#include <cstdint>
+#include <limits>
+#include <optional>
+
+#include "yarvs/bits_manipulation.hpp"
+#include "yarvs/common.hpp"
+#include "yarvs/decoder.hpp"
+#include "yarvs/hart.hpp"
+#include "yarvs/identifiers.hpp"
+#include "yarvs/instruction.hpp"
+
+namespace yarvs
+{
+
+/*
+ * Fields of fused pseudo-instructions:
+ *
+ * lui+addi, lui+addiw:    rd, imm = the resulting constant
+ * auipc+jalr, auipc+ld:   rs1 = rd of auipc, rd = rd of the second instruction, imm = imm of auipc
+ *                         and imm of the second instruction (see fused_auipc_imm)
+ * slli+srli:              rd, rs1, imm = shift amount
+ * slt(u)+beqz/bnez:       rd, rs1, rs2 of slt(u), imm = offset of the branch target from slt(u)
+ */
+std::optional<Instruction> Decoder::fuse(const Instruction &first,
+                                         const Instruction &second) noexcept
+{
+    // the second instruction consumes the result of the first one
+    if (first.rd == 0 || second.rs1 != first.rd)
+        return std::nullopt;
+
+    switch (first.id)
+    {
+        case InstrID::kLUI:
+            if (second.rd != first.rd)
+                break;
+            if (second.id == InstrID::kADDI)
+            {
+                // the constant may not fit in the immediate (e.g. lui 0x80000 + addi -1)
+                using limits = std::numeric_limits<Instruction::immediate_type>;
+                const auto constant = std::int64_t{first.imm} + second.imm;
+                if (constant < limits::min() || constant > limits::max())
+                    break;
+                return Instruction{
+                    .handler = &Hart::exec_lui_addi,
+                    .id = InstrID::kLUI_ADDI,
+                    .rd = first.rd,
+                    .imm = static_cast<Instruction::immediate_type>(constant)
+                };
+            }
+            if (second.id == InstrID::kADDIW)
+                return Instruction{
+                    .handler = &Hart::exec_lui_addiw,
+                    .id = InstrID::kLUI_ADDIW,
+                    .rd = first.rd,
+                    .imm = static_cast<Instruction::immediate_type>(
+                        static_cast<Word>(first.imm) + static_cast<Word>(second.imm))
+                };
+            break;
+
+        case InstrID::kAUIPC:
+        {
+            const auto imm = first.imm | (second.imm & 0xfff);
+            if (second.id == InstrID::kJALR)
+                return Instruction{
+                    .handler = &Hart::exec_auipc_jalr,
+                    .id = InstrID::kAUIPC_JALR,
+                    .rs1 = first.rd,
+                    .rd = second.rd,
+                    .imm = imm
+                };
+            if (second.id == InstrID::kLD)
+                return Instruction{
+                    .handler = &Hart::exec_auipc_ld,
+                    .id = InstrID::kAUIPC_LD,
+                    .rs1 = first.rd,
+                    .rd = second.rd,
+                    .imm = imm
+                };
+            break;
+        }
+
+        case InstrID::kSLLI:
+            if (second.id == InstrID::kSRLI && second.rd == first.rd &&
+                (second.imm & 0x3f) == (first.imm & 0x3f))
+                return Instruction{
+                    .handler = &Hart::exec_slli_srli,
+                    .id = InstrID::kSLLI_SRLI,
+                    .rs1 = first.rs1,
+                    .rd = first.rd,
+                    .imm = first.imm & 0x3f
+                };
+            break;
+
+        case InstrID::kSLT:
+        case InstrID::kSLTU:
+        {
+            if (second.rs2 != 0 || (second.id != InstrID::kBNE && second.id != InstrID::kBEQ))
+                break;
+
+            const bool sltu = (first.id == InstrID::kSLTU);
+            const bool bnez = (second.id == InstrID::kBNE);
+
+            Instruction fused{
+                .rs1 = first.rs1,
+                .rs2 = first.rs2,
+                .rd = first.rd,
+                .imm = second.imm + static_cast<Instruction::immediate_type>(sizeof(RawInstruction))
+            };
+
+            if (sltu)
+            {
+                fused.handler = bnez ? &Hart::exec_sltu_bnez : &Hart::exec_sltu_beqz;
+                fused.id = bnez ? InstrID::kSLTU_BNEZ : InstrID::kSLTU_BEQZ;
+            }
+            else
+            {
+                fused.handler = bnez ? &Hart::exec_slt_bnez : &Hart::exec_slt_beqz;
+                fused.id = bnez ? InstrID::kSLT_BNEZ : InstrID::kSLT_BEQZ;
+            }
+
+            return fused;
+        }
+
+        default:
+            break;
+    }
+
+    return std::nullopt;
+}
+
+} // namespace yarvs
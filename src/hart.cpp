@@ -1,5 +1,10 @@
+#include <algorithm>
 #include <cstdint>
+#include <memory>
+#include <optional>
 #include <ranges>
+#include <span>
+#include <stdexcept>
 #include <system_error>
 #include <utility>
 
@@ -14,11 +19,15 @@
 namespace yarvs
 {
 
-Hart::Hart()
-    : priv_level_{PrivilegeLevel::kMachine}, mem_{csrs_, priv_level_},
-      bb_cache_{kDefaultCacheCapacity}
+Hart::Hart(std::size_t bb_cache_capacity, const MemoryOptions &mem_options)
+    : priv_level_{PrivilegeLevel::kMachine}, mem_{csrs_, priv_level_, mem_options},
+      bb_cache_{bb_cache_capacity}, bb_arena_{bb_cache_capacity * kArenaBytesPerBlock},
+      cold_executions_(bb_cache_capacity), branch_counters_(bb_cache_capacity)
 {
-    csrs_.set_misa(MISA::Extensions::kI | MISA::Extensions::kS | MISA::Extensions::kU);
+    if constexpr (kUserISA)
+        csrs_.set_misa(MISA::Extensions::kI | MISA::Extensions::kU);
+    else
+        csrs_.set_misa(MISA::Extensions::kI | MISA::Extensions::kS | MISA::Extensions::kU);
 }
 
 void Hart::set_log_file(std::string_view file_name)
@@ -34,11 +43,39 @@ void Hart::set_log_file(std::string_view file_name)
     }
 }
 
-bool Hart::execute(const Instruction &instr)
+void Hart::set_tier_thresholds(const TierThresholds &thresholds)
+{
+    if (thresholds.decoded == 0 || thresholds.native == 0)
+        throw std::invalid_argument{"tier thresholds shall be positive"};
+    tier_thresholds_ = thresholds;
+}
+
+void Hart::set_jit(bool jit, std::size_t code_buffer_size)
+{
+    if (!jit)
+    {
+        jit_.reset();
+        flush_bb_cache(); // cached blocks refer to the translated code
+        return;
+    }
+
+    if (!JIT::kSupported)
+        throw std::runtime_error{"JIT is not supported on this host"};
+    if (!jit_)
+        jit_ = std::make_unique<JIT>(&jit_fallback, code_buffer_size);
+}
+
+void Hart::predecode(DoubleWord va, DoubleWord pa, std::span<const Byte> code)
 {
-    if (!logging_)
-        return kCallbacks_[instr.id](*this, instr);
+    predecoded_code_.add_segment(va, pa, code);
 
+    // stores to the segment shall invalidate it
+    for (auto page = pa / Memory::kPageSize; page * Memory::kPageSize < pa + code.size(); ++page)
+        mem_.mark_code_page(page);
+}
+
+bool Hart::execute_logged(const Instruction &instr)
+{
     fmt::println(log_file_.get(), "[{:#010x}]: {}", pc_, instr.disassemble());
     if (instr.id == InstrID::kECALL)
     {
@@ -50,7 +87,7 @@ bool Hart::execute(const Instruction &instr)
 
     const auto old_gprs_ = gprs_;
 
-    const bool res = kCallbacks_[instr.id](*this, instr);
+    const bool res = execute_single(instr);
 
     auto diff_view = std::views::zip(std::views::iota(0uz), old_gprs_, gprs_)
                    | std::views::filter([](const auto &t){
@@ -72,19 +109,114 @@ bool Hart::run_single() {
         raise_exception(raw_instr_or_err.error(), pc_);
         return false;
     }
-    else if (!execute(Decoder::decode(*raw_instr_or_err))) [[unlikely]]
+    else if (const auto instr = Decoder::decode(*raw_instr_or_err);
+             !(logging_ ? execute<true>(instr) : execute<false>(instr))) [[unlikely]]
         return false;
     else if (!run_)
         return false;
     return true;
 }
 
+template<bool kLogging>
+bool Hart::execute_trace(const BasicBlock &bb, std::uintmax_t &instr_count)
+{
+    for (auto segment = bb.segments.begin();;)
+    {
+        const auto instrs = bb.body(*segment);
+
+        bool success = true;
+        if constexpr (kTailCalls && !kLogging)
+            success = instrs.front().handler(*this, instrs.front());
+        else
+        {
+            for (const auto &instr : instrs)
+                if (!(success = execute<kLogging>(instr))) [[unlikely]]
+                    break;
+        }
+
+        if (!success) [[unlikely]]
+        {
+            /*
+             * Instructions of a segment are executed sequentially up to the faulting one. It may be
+             * the second half of a fused pair, so the count is derived from its address.
+             */
+            const auto epc = (priv_level_ == PrivilegeLevel::kMachine) ? csrs_.get_mepc()
+                                                                       : csrs_.get_sepc();
+            instr_count += (epc - segment->pc) / sizeof(RawInstruction);
+            return false;
+        }
+        instr_count += segment->length;
+
+        // a branch might have left the trace through a side exit
+        if (++segment == bb.segments.end() || pc_ != segment->pc)
+            return true;
+    }
+}
+
+Hart::BasicBlock *Hart::cache_block(const BlockBuilder &builder)
+{
+    const auto footprint = builder.footprint();
+    if (footprint > bb_arena_.capacity()) [[unlikely]]
+        return nullptr;
+    if (footprint > bb_arena_.available())
+        flush_bb_cache();
+
+    const auto pc = builder.segments.front().pc;
+    return &bb_cache_.update(pc, BasicBlock{.pc = pc,
+                                            .instrs = bb_arena_.copy<Instruction>(builder.instrs),
+                                            .segments = bb_arena_.copy<BasicBlock::Segment>(
+                                                builder.segments),
+                                            .pages = bb_arena_.copy<DoubleWord>(builder.pages)});
+}
+
+// never called from translated code, so the code of the dropped blocks can be reused
+void Hart::flush_bb_cache() noexcept
+{
+    bb_cache_.clear();
+    bb_arena_.clear();
+    if (jit_)
+        jit_->reset();
+    ++bb_cache_flushes_;
+}
+
+void Hart::invalidate_modified_code()
+{
+    if (mem_.all_code_modified())
+    {
+        flush_bb_cache();
+        predecoded_code_.clear();
+    }
+    else
+    {
+        const auto &modified = mem_.modified_code_pages();
+        predecoded_code_.invalidate_pages(modified);
+        bb_cache_.erase_if([&modified](const BasicBlock &bb)
+        {
+            return std::ranges::any_of(bb.pages, [&modified](DoubleWord ppn)
+            {
+                return std::ranges::find(modified, ppn) != modified.end();
+            });
+        });
+    }
+    mem_.reset_code_modified();
+}
+
 std::uintmax_t Hart::run()
 {
     priv_level_ = PrivilegeLevel::kUser;
+    mem_.flush_tlb();
     run_ = true;
 
-    BasicBlock bb;
+    return logging_ ? run_loop<true>() : run_loop<false>();
+}
+
+template<bool kLogging>
+std::uintmax_t Hart::run_loop()
+{
+    BlockBuilder new_bb; // the buffers are reused by all the blocks
+
+    // the last executed block; it is linked to its successor if it ends with a direct jump
+    BasicBlock *prev_bb = nullptr;
 
     /*
      * Instruction that raises exception isn't considered executed until return from the exception
@@ -93,42 +225,152 @@ std::uintmax_t Hart::run()
     std::uintmax_t instr_count = 0;
     while (run_)
     {
-        exception:
+        /*
+         * Stores to code become visible to instruction fetches at block boundaries. It's enough
+         * for the program to observe them after FENCE.I, which always ends a block.
+         */
+        if (mem_.code_modified()) [[unlikely]]
+        {
+            invalidate_modified_code();
+            prev_bb = nullptr;
+        }
+
+        BasicBlock *bb = prev_bb ? prev_bb->successor(pc_) : nullptr;
+        if (bb)
+            ++bb_chain_hits_;
+        else if ((bb = bb_cache_.lookup(pc_)) && prev_bb)
+            prev_bb->link(*bb);
 
-        if (auto bb_it = bb_cache_.lookup(pc_); bb_it != bb_cache_.end())
+        if (bb)
         {
-            for (const auto &instr : bb_it->second)
+            if (!kLogging && jit_ && !bb->native &&
+                ++bb->n_executions == tier_thresholds_.native)
             {
-                if (!execute(instr)) [[unlikely]]
+                std::vector<JIT::Segment> trace;
+                for (const auto &segment : bb->segments)
+                    trace.push_back({.pc = segment.pc, .instrs = bb->body(segment)});
+                bb->native = jit_->translate(trace);
+            }
+
+            if (!kLogging && bb->native)
+            {
+                ++tier_executions_[Tier::kNative];
+                const auto [n_executed, trapped] = bb->native(*this, gprs_.data(), &pc_);
+                instr_count += n_executed;
+                if (trapped) [[unlikely]]
+                    goto exception;
+            }
+            else
+            {
+                ++tier_executions_[Tier::kDecoded];
+                if (!execute_trace<kLogging>(*bb, instr_count)) [[unlikely]]
                     goto exception;
-                ++instr_count;
             }
         }
         else
         {
-            bb.reserve(kDefaultBBLength);
+            ++tier_executions_[Tier::kInterpreted];
+
+            // cold code is interpreted without being cached until it gets warm
+            auto &cold_executions = cold_executions_[cold_index(pc_)];
+            const bool promote = ++cold_executions >= tier_thresholds_.decoded;
+
+            // the previous block might have been left incomplete by an exception
+            new_bb.clear();
+            if (promote) // a trace is at least as long as its first basic block
+                new_bb.instrs.reserve(std::max(kDefaultBBLength,
+                                               predecoded_code_.block_size(pc_) + 1));
 
-            const auto bb_pc = pc_;
+            new_bb.segments.push_back({.pc = pc_, .begin = 0, .size = 0, .length = 0});
 
             for (;;)
             {
-                const auto raw_instr_or_err = mem_.fetch(pc_);
+                DoubleWord ppn;
+                const auto raw_instr_or_err = mem_.fetch(pc_, ppn);
                 if (!raw_instr_or_err.has_value()) [[unlikely]]
                 {
                     raise_exception(raw_instr_or_err.error(), pc_);
                     goto exception;
                 }
-                const auto &instr = bb.emplace_back(Decoder::decode(*raw_instr_or_err));
-                if (!execute(instr)) [[unlikely]]
+
+                // predecoded code is only used once the fetch has passed translation
+                const auto predecoded = predecoded_code_.find(ppn * Memory::kPageSize +
+                                                              pc_ % Memory::kPageSize);
+                const Instruction instr = predecoded ? *predecoded
+                                                     : Decoder::decode(*raw_instr_or_err);
+                if (promote)
+                {
+                    if (std::ranges::find(new_bb.pages, ppn) == new_bb.pages.end())
+                        new_bb.pages.push_back(ppn);
+
+                    // the log shows instructions as they are, so they aren't fused when logging
+                    auto &segment = new_bb.segments.back();
+                    std::optional<Instruction> fused;
+                    if (!kLogging && segment.size != 0)
+                        fused = Decoder::fuse(new_bb.instrs.back(), instr);
+
+                    if (fused)
+                        new_bb.instrs.back() = *fused;
+                    else
+                    {
+                        new_bb.instrs.push_back(instr);
+                        ++segment.size;
+                    }
+                    ++segment.length;
+                }
+                const auto instr_pc = pc_;
+                if (!execute<kLogging>(instr)) [[unlikely]]
                     goto exception;
                 ++instr_count;
-                if (instr.is_terminator())
+                if (!instr.is_terminator())
+                    continue;
+
+                // jal always goes the same way; conditional branches are the other direct jumps
+                bool majority = true;
+                if (instr.is_direct_jump() && instr.id != InstrID::kJAL)
+                    majority = record_branch(
+                        instr_pc, pc_ != instr_pc + instr.length() * sizeof(RawInstruction));
+
+                /*
+                 * The trace follows direct jumps in the direction they have taken this time if
+                 * it's the usual one. It ends on reaching code that is already in it, so loops are
+                 * not unrolled.
+                 */
+                if (!promote || !instr.is_direct_jump() || !majority ||
+                    new_bb.instrs.size() >= kMaxTraceLength || new_bb.contains(pc_))
                     break;
+
+                if constexpr (kTailCalls)
+                    new_bb.instrs.push_back(kBlockEnd);
+                new_bb.segments.push_back(
+                    {.pc = pc_, .begin = new_bb.instrs.size(), .size = 0, .length = 0});
             }
 
-            bb_cache_.update(bb_pc, std::move(bb));
-            bb.clear(); // just in case: moved-from object is in valid but unspecified state
+            if (!promote)
+            {
+                prev_bb = nullptr;
+                continue;
+            }
+
+            cold_executions = 0;
+
+            if constexpr (kTailCalls)
+                new_bb.instrs.push_back(kBlockEnd);
+
+            // a flush of the cache makes prev_bb dangle
+            const auto n_flushes = bb_cache_flushes_;
+            bb = cache_block(new_bb);
+            if (bb_cache_flushes_ != n_flushes)
+                prev_bb = nullptr;
+            if (prev_bb && bb)
+                prev_bb->link(*bb);
         }
+
+        prev_bb = bb;
+        continue;
+
+        exception:
+        prev_bb = nullptr;
     }
 
     return instr_count;
@@ -0,0 +1,459 @@
+#include <bit>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <span>
+
+#include "yarvs/common.hpp"
+#include "yarvs/decoder.hpp"
+#include "yarvs/instruction.hpp"
+
+#include "yarvs/jit/jit.hpp"
+#include "yarvs/jit/x86_64_emitter.hpp"
+
+namespace yarvs
+{
+
+namespace
+{
+
+using Emitter = X86_64Emitter;
+using Reg = Emitter::Reg;
+using Width = Emitter::Width;
+
+/*
+ * Registers preserved across calls (System V ABI) keep the state of the hart in translated code.
+ * rax, rcx and rdx are scratch registers.
+ */
+constexpr Reg kGPRs = Reg::kRBX;
+constexpr Reg kHart = Reg::kR12;
+constexpr Reg kPC = Reg::kR13;
+
+constexpr std::int32_t gpr_offset(std::size_t i) noexcept
+{
+    return static_cast<std::int32_t>(i * sizeof(DoubleWord));
+}
+
+// JIT::Result is returned in rax
+constexpr DoubleWord result(std::uint32_t n_executed, bool trapped) noexcept
+{
+    static_assert(sizeof(JIT::Result) == sizeof(DoubleWord));
+    return std::bit_cast<DoubleWord>(JIT::Result{.n_executed = n_executed, .trapped = trapped});
+}
+
+} // unnamed namespace
+
+JIT::JIT(Instruction::handler_type fallback, std::size_t code_buffer_size)
+    : fallback_{fallback},
+      code_buffer_{code_buffer_size, MMapWrapper::kRead | MMapWrapper::kWrite | MMapWrapper::kExec},
+      code_buffer_size_{code_buffer_size} {}
+
+JIT::entry_type JIT::translate(std::span<const Segment> trace)
+{
+    emitter_.clear();
+    exits_.clear();
+
+    // 3 pushes on top of the return address keep the stack 16-byte aligned for calls
+    emitter_.push(kGPRs);
+    emitter_.push(kHart);
+    emitter_.push(kPC);
+    emitter_.mov(kHart, Reg::kRDI);
+    emitter_.mov(kGPRs, Reg::kRSI);
+    emitter_.mov(kPC, Reg::kRDX);
+
+    ir_.clear();
+    std::uint32_t n_executed = 0;
+    DoubleWord end_pc = 0;
+    for (auto segment = trace.begin(); segment != trace.end(); ++segment)
+    {
+        const auto next_segment = std::next(segment);
+        DoubleWord pc = segment->pc;
+        for (std::size_t i = 0; i != segment->instrs.size(); ++i)
+        {
+            const auto &instr = segment->instrs[i];
+
+            std::optional<DoubleWord> next_pc;
+            if (i + 1 == segment->instrs.size() && next_segment != trace.end())
+                next_pc = next_segment->pc;
+
+            ir_.append(instr, pc, n_executed, next_pc);
+
+            pc += instr.length() * sizeof(RawInstruction);
+            n_executed += instr.length();
+        }
+        end_pc = pc;
+    }
+
+    ir_.optimize();
+
+    pc_value_ = trace.front().pc;
+    rax_gpr_.reset();
+    for (const auto &node : ir_.nodes())
+    {
+        if (node.dead)
+            continue;
+        if (!translate_native(node))
+            translate_fallback(node);
+    }
+
+    if (!trace.back().instrs.back().is_terminator())
+        exit(end_pc, n_executed);
+
+    // epilogue; rax holds the result
+    for (const auto fixup : exits_)
+        emitter_.bind(fixup);
+    emitter_.pop(kPC);
+    emitter_.pop(kHart);
+    emitter_.pop(kGPRs);
+    emitter_.ret();
+
+    const auto &code = emitter_.code();
+    if (code_size_ + code.size() > code_buffer_size_) [[unlikely]]
+        return nullptr;
+
+    Byte *entry = &code_buffer_[code_size_];
+    std::memcpy(entry, code.data(), code.size());
+
+    constexpr std::size_t kCodeAlignment = 16;
+    code_size_ += (code.size() + kCodeAlignment - 1) & ~(kCodeAlignment - 1);
+    ++translated_blocks_;
+
+    return reinterpret_cast<entry_type>(entry);
+}
+
+// the code mirrors the interpreter (see executor.cpp)
+bool JIT::translate_native(const TraceIR::Node &node)
+{
+    const auto &instr = *node.instr;
+    const auto pc = node.pc;
+    const auto &next_pc = node.next_pc;
+
+    if (node.result) // folded by the IR
+    {
+        emitter_.mov(Reg::kRAX, *node.result);
+        store_gpr(instr.rd, Reg::kRAX);
+        return true;
+    }
+
+    auto reg_reg = [&](Emitter::ALUOp op, Width width)
+    {
+        load_gpr(Reg::kRAX, instr.rs1, node.rs1_value);
+        load_gpr(Reg::kRCX, instr.rs2, node.rs2_value);
+        emitter_.alu(op, Reg::kRAX, Reg::kRCX, width);
+        if (width == Width::k32)
+            emitter_.movsxd(Reg::kRAX, Reg::kRAX);
+        store_gpr(instr.rd, Reg::kRAX);
+    };
+
+    auto reg_imm = [&](Emitter::ALUOp op, Width width)
+    {
+        load_gpr(Reg::kRAX, instr.rs1, node.rs1_value);
+        alu_imm(op, Reg::kRAX, instr.imm, width);
+        if (width == Width::k32)
+            emitter_.movsxd(Reg::kRAX, Reg::kRAX);
+        store_gpr(instr.rd, Reg::kRAX);
+    };
+
+    auto set_reg_reg = [&](Emitter::Cond cond)
+    {
+        load_gpr(Reg::kRAX, instr.rs1, node.rs1_value);
+        load_gpr(Reg::kRCX, instr.rs2, node.rs2_value);
+        emitter_.alu(Emitter::kCmp, Reg::kRAX, Reg::kRCX);
+        emitter_.setcc(cond, Reg::kRAX);
+        store_gpr(instr.rd, Reg::kRAX);
+    };
+
+    auto set_reg_imm = [&](Emitter::Cond cond)
+    {
+        load_gpr(Reg::kRAX, instr.rs1, node.rs1_value);
+        alu_imm(Emitter::kCmp, Reg::kRAX, instr.imm);
+        emitter_.setcc(cond, Reg::kRAX);
+        store_gpr(instr.rd, Reg::kRAX);
+    };
+
+    // x86-64 masks shift amounts to the operand width just like RISC-V does
+    auto shift_reg = [&](Emitter::ShiftOp op, Width width)
+    {
+        load_gpr(Reg::kRAX, instr.rs1, node.rs1_value);
+        load_gpr(Reg::kRCX, instr.rs2, node.rs2_value);
+        emitter_.shift(op, Reg::kRAX, width);
+        if (width == Width::k32)
+            emitter_.movsxd(Reg::kRAX, Reg::kRAX);
+        store_gpr(instr.rd, Reg::kRAX);
+    };
+
+    auto shift_imm = [&](Emitter::ShiftOp op, Width width)
+    {
+        load_gpr(Reg::kRAX, instr.rs1, node.rs1_value);
+        const auto mask = (width == Width::k32) ? 0x1f : 0x3f;
+        emitter_.shift(op, Reg::kRAX, static_cast<Byte>(instr.imm & mask), width);
+        if (width == Width::k32)
+            emitter_.movsxd(Reg::kRAX, Reg::kRAX);
+        store_gpr(instr.rd, Reg::kRAX);
+    };
+
+    const DoubleWord fall_through_pc = pc + instr.length() * sizeof(RawInstruction);
+    const DoubleWord target_pc = pc + instr.imm;
+    const std::uint32_t n_retired = node.n_executed + instr.length();
+
+    // the direction of the branch is known statically
+    auto jump = [&](bool taken)
+    {
+        const auto dest = taken ? target_pc : fall_through_pc;
+        if (next_pc != dest)
+            exit(dest, n_retired);
+    };
+
+    // jumps on the flags set before; only the direction leaving the trace needs an exit
+    auto branch_on = [&](Emitter::Cond cond)
+    {
+        if (next_pc == target_pc)
+        {
+            const auto stay = emitter_.jcc(cond);
+            exit(fall_through_pc, n_retired);
+            emitter_.bind(stay);
+        }
+        else if (next_pc == fall_through_pc)
+        {
+            const auto stay = emitter_.jcc(Emitter::negate(cond));
+            exit(target_pc, n_retired);
+            emitter_.bind(stay);
+        }
+        else
+        {
+            const auto taken = emitter_.jcc(cond);
+            exit(fall_through_pc, n_retired);
+            emitter_.bind(taken);
+            exit(target_pc, n_retired);
+        }
+    };
+
+    auto branch = [&](Emitter::Cond cond)
+    {
+        if (node.taken)
+            return jump(*node.taken);
+
+        load_gpr(Reg::kRAX, instr.rs1, node.rs1_value);
+        load_gpr(Reg::kRCX, instr.rs2, node.rs2_value);
+        emitter_.alu(Emitter::kCmp, Reg::kRAX, Reg::kRCX);
+        branch_on(cond);
+    };
+
+    // neither setcc nor the store of rd changes the flags of the comparison
+    auto set_branch = [&](Emitter::Cond less, bool taken_if_set)
+    {
+        if (node.taken)
+        {
+            emitter_.mov(Reg::kRAX, DoubleWord{*node.taken == taken_if_set});
+            store_gpr(instr.rd, Reg::kRAX);
+            return jump(*node.taken);
+        }
+
+        set_reg_reg(less);
+        branch_on(taken_if_set ? less : Emitter::negate(less));
+    };
+
+    switch (instr.id)
+    {
+        case InstrID::kADD: reg_reg(Emitter::kAdd, Width::k64); break;
+        case InstrID::kSUB: reg_reg(Emitter::kSub, Width::k64); break;
+        case InstrID::kAND: reg_reg(Emitter::kAnd, Width::k64); break;
+        case InstrID::kOR: reg_reg(Emitter::kOr, Width::k64); break;
+        case InstrID::kXOR: reg_reg(Emitter::kXor, Width::k64); break;
+        case InstrID::kSLT: set_reg_reg(Emitter::kL); break;
+        case InstrID::kSLTU: set_reg_reg(Emitter::kB); break;
+        case InstrID::kSLL: shift_reg(Emitter::kShl, Width::k64); break;
+        case InstrID::kSRL: shift_reg(Emitter::kShr, Width::k64); break;
+        case InstrID::kSRA: shift_reg(Emitter::kSar, Width::k64); break;
+
+        case InstrID::kADDW: reg_reg(Emitter::kAdd, Width::k32); break;
+        case InstrID::kSUBW: reg_reg(Emitter::kSub, Width::k32); break;
+        case InstrID::kSLLW: shift_reg(Emitter::kShl, Width::k32); break;
+        case InstrID::kSRLW: shift_reg(Emitter::kShr, Width::k32); break;
+        case InstrID::kSRAW: shift_reg(Emitter::kSar, Width::k32); break;
+
+        case InstrID::kADDI: reg_imm(Emitter::kAdd, Width::k64); break;
+        case InstrID::kANDI: reg_imm(Emitter::kAnd, Width::k64); break;
+        case InstrID::kORI: reg_imm(Emitter::kOr, Width::k64); break;
+        case InstrID::kXORI: reg_imm(Emitter::kXor, Width::k64); break;
+        case InstrID::kSLTI: set_reg_imm(Emitter::kL); break;
+        case InstrID::kSLTIU: set_reg_imm(Emitter::kB); break;
+        case InstrID::kSLLI: shift_imm(Emitter::kShl, Width::k64); break;
+        case InstrID::kSRLI: shift_imm(Emitter::kShr, Width::k64); break;
+        case InstrID::kSRAI: shift_imm(Emitter::kSar, Width::k64); break;
+
+        case InstrID::kADDIW: reg_imm(Emitter::kAdd, Width::k32); break;
+        case InstrID::kSLLIW: shift_imm(Emitter::kShl, Width::k32); break;
+        case InstrID::kSRLIW: shift_imm(Emitter::kShr, Width::k32); break;
+        case InstrID::kSRAIW: shift_imm(Emitter::kSar, Width::k32); break;
+
+        case InstrID::kLUI:
+            emitter_.mov(Reg::kRAX, instr.imm);
+            store_gpr(instr.rd, Reg::kRAX);
+            break;
+        case InstrID::kAUIPC:
+            emitter_.mov(Reg::kRAX, pc + instr.imm);
+            store_gpr(instr.rd, Reg::kRAX);
+            break;
+
+        case InstrID::kJAL:
+            emitter_.mov(Reg::kRAX, fall_through_pc);
+            store_gpr(instr.rd, Reg::kRAX);
+            if (!next_pc) // otherwise the trace goes on at the target
+                exit(target_pc, n_retired);
+            break;
+        case InstrID::kJALR:
+            // before rd is written: rd may be equal to rs1
+            load_gpr(Reg::kRAX, instr.rs1, node.rs1_value);
+            alu_imm(Emitter::kAdd, Reg::kRAX, instr.imm);
+            emitter_.alu(Emitter::kAnd, Reg::kRAX, ~std::int32_t{1});
+            emitter_.mov(Reg::kRCX, fall_through_pc);
+            store_gpr(instr.rd, Reg::kRCX);
+            exit(Reg::kRAX, n_retired);
+            break;
+
+        case InstrID::kBEQ: branch(Emitter::kE); break;
+        case InstrID::kBNE: branch(Emitter::kNE); break;
+        case InstrID::kBLT: branch(Emitter::kL); break;
+        case InstrID::kBGE: branch(Emitter::kGE); break;
+        case InstrID::kBLTU: branch(Emitter::kB); break;
+        case InstrID::kBGEU: branch(Emitter::kAE); break;
+
+        case InstrID::kLUI_ADDI:
+        case InstrID::kLUI_ADDIW:
+            emitter_.mov(Reg::kRAX, instr.imm);
+            store_gpr(instr.rd, Reg::kRAX);
+            break;
+        case InstrID::kAUIPC_JALR:
+        {
+            const DoubleWord base = pc + Decoder::fused_auipc_imm(instr);
+            emitter_.mov(Reg::kRAX, base);
+            store_gpr(instr.rs1, Reg::kRAX);
+            emitter_.mov(Reg::kRAX, fall_through_pc);
+            store_gpr(instr.rd, Reg::kRAX);
+            exit((base + Decoder::fused_offset_imm(instr)) & ~DoubleWord{1}, n_retired);
+            break;
+        }
+        case InstrID::kSLLI_SRLI:
+            load_gpr(Reg::kRAX, instr.rs1, node.rs1_value);
+            emitter_.shift(Emitter::kShl, Reg::kRAX, static_cast<Byte>(instr.imm));
+            emitter_.shift(Emitter::kShr, Reg::kRAX, static_cast<Byte>(instr.imm));
+            store_gpr(instr.rd, Reg::kRAX);
+            break;
+        case InstrID::kSLT_BNEZ: set_branch(Emitter::kL, true); break;
+        case InstrID::kSLT_BEQZ: set_branch(Emitter::kL, false); break;
+        case InstrID::kSLTU_BNEZ: set_branch(Emitter::kB, true); break;
+        case InstrID::kSLTU_BEQZ: set_branch(Emitter::kB, false); break;
+
+        default:
+            return false;
+    }
+
+    return true;
+}
+
+void JIT::translate_fallback(const TraceIR::Node &node)
+{
+    const auto &instr = *node.instr;
+    const auto n_executed = node.n_executed;
+
+    /*
+     * The handler may read pc_ and raise an exception at it. Native code doesn't update pc_, so
+     * it's stored only if it isn't left there by the previous handler.
+     */
+    if (pc_value_ != node.pc)
+    {
+        emitter_.mov(Reg::kRAX, node.pc);
+        emitter_.store(kPC, 0, Reg::kRAX);
+    }
+
+    rax_gpr_.reset(); // the handler may write any register, and the call clobbers rax
+    emitter_.mov(Reg::kRDI, kHart);
+    emitter_.mov(Reg::kRSI, reinterpret_cast<DoubleWord>(&instr));
+    emitter_.mov(Reg::kRAX, reinterpret_cast<DoubleWord>(fallback_));
+    emitter_.call(Reg::kRAX);
+
+    // only the second instruction of a fused pair may raise an exception
+    emitter_.test8(Reg::kRAX, Reg::kRAX);
+    const auto success = emitter_.jcc(Emitter::kNE);
+    trap(n_executed + instr.length() - 1);
+    emitter_.bind(success);
+
+    if (instr.is_terminator()) // the handler has set pc_ to the next instruction
+    {
+        emitter_.mov(Reg::kRAX, result(n_executed + instr.length(), false));
+        exits_.push_back(emitter_.jmp());
+    }
+    else
+        pc_value_ = node.pc + instr.length() * sizeof(RawInstruction);
+}
+
+/*
+ * Operands are loaded before rax is computed, and a result computed in rax is stored right after.
+ * Hence rax holds the register it has been loaded from or stored to last, unless the value has
+ * been dropped in between.
+ */
+void JIT::load_gpr(Reg reg, std::size_t i, std::optional<DoubleWord> value)
+{
+    if (i == 0)
+        emitter_.mov(reg, DoubleWord{0});
+    else if (value)
+        emitter_.mov(reg, *value);
+    else if (rax_gpr_ == i)
+    {
+        if (reg != Reg::kRAX)
+            emitter_.mov(reg, Reg::kRAX);
+        return;
+    }
+    else
+        emitter_.load(reg, kGPRs, gpr_offset(i));
+
+    if (reg == Reg::kRAX)
+        rax_gpr_ = (i != 0) ? std::optional{i} : std::nullopt;
+}
+
+void JIT::store_gpr(std::size_t i, Reg reg)
+{
+    if (reg == Reg::kRAX)
+        rax_gpr_ = (i != 0) ? std::optional{i} : std::nullopt;
+    else if (rax_gpr_ == i)
+        rax_gpr_.reset();
+
+    if (i != 0)
+        emitter_.store(kGPRs, gpr_offset(i), reg);
+}
+
+void JIT::alu_imm(Emitter::ALUOp op, Reg reg, DoubleWord imm, Width width)
+{
+    if (Emitter::fits_int32(imm))
+        emitter_.alu(op, reg, static_cast<std::int32_t>(imm), width);
+    else
+    {
+        emitter_.mov(Reg::kRDX, imm);
+        emitter_.alu(op, reg, Reg::kRDX, width);
+    }
+}
+
+void JIT::exit(DoubleWord next_pc, std::uint32_t n_executed)
+{
+    emitter_.mov(Reg::kRAX, next_pc);
+    exit(Reg::kRAX, n_executed);
+}
+
+// the code following an exit is reached by the paths that have not taken it
+void JIT::exit(Reg next_pc, std::uint32_t n_executed)
+{
+    rax_gpr_.reset();
+    emitter_.store(kPC, 0, next_pc);
+    emitter_.mov(Reg::kRAX, result(n_executed, false));
+    exits_.push_back(emitter_.jmp());
+}
+
+// pc_ has been set by Hart::raise_exception
+void JIT::trap(std::uint32_t n_executed)
+{
+    emitter_.mov(Reg::kRAX, result(n_executed, true));
+    exits_.push_back(emitter_.jmp());
+}
+
+} // namespace yarvs
@@ -1,11 +1,17 @@
+#include <algorithm>
 #include <array>
+#include <bit>
 #include <cassert>
+#include <charconv>
 #include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <exception>
 #include <filesystem>
 #include <ranges>
+#include <stdexcept>
 #include <string>
+#include <system_error>
 #include <utility>
 
 #include <CLI/CLI.hpp>
@@ -23,6 +29,17 @@
 
 namespace {
 
+// rejects values that are not powers of 2 with a message naming the value
+const CLI::Validator kPowerOfTwo{[](const std::string &value)
+{
+    std::size_t n = 0;
+    const auto *const last = value.data() + value.size();
+    const auto [ptr, ec] = std::from_chars(value.data(), last, n);
+    if (ec != std::errc{} || ptr != last || !std::has_single_bit(n))
+        return fmt::format("{} is not a power of 2", value);
+    return std::string{};
+}, "POWER_OF_TWO"};
+
 yarvs::DoubleWord get_initial_sp(yarvs::SATP::Mode translation_mode)
 {
     yarvs::DoubleWord sp;
@@ -73,7 +90,8 @@ auto loadable_pages_to_flags(yarvs::ELFLoader &elf, yarvs::DoubleWord stack_top,
 }
 
 void initialize_hart(yarvs::Hart &hart, const std::filesystem::path &elf_path,
-                     yarvs::SATP::Mode translation_mode, std::size_t stack_pages_count)
+                     yarvs::SATP::Mode translation_mode, std::size_t stack_pages_count,
+                     bool predecode)
 {
     constexpr yarvs::PTE kPointerToNextLevelPTE = 0b10001;
     static_assert(kPointerToNextLevelPTE.get_U() && kPointerToNextLevelPTE.get_V());
@@ -97,15 +115,30 @@ void initialize_hart(yarvs::Hart &hart, const std::filesystem::path &elf_path,
     // Set entry point
     hart.set_pc(elf.get_entry());
 
+    // The first quarter of physical memory holds page tables, the rest holds code and data
+    const auto phys_mem_size = hart.memory().phys_mem_size();
+    const auto n_phys_pages = phys_mem_size / yarvs::Memory::kPageSize;
+    const auto first_data_ppn = n_phys_pages / 4;
+    const auto too_small = [phys_mem_size]
+    {
+        return std::runtime_error{fmt::format("{} MB of physical memory is too small for the "
+                                              "program: use a larger --memory-size",
+                                              phys_mem_size >> 20)};
+    };
+
+    const auto pages = loadable_pages_to_flags(elf, stack_top, stack_pages_count);
+    if (kRootPageTablePPN >= first_data_ppn || pages.size() > n_phys_pages - first_data_ppn)
+        throw too_small();
+
     // PPN of the currently processed physical page of the page table
     yarvs::DoubleWord table_ppn = kRootPageTablePPN + 1;
 
     // PPN of the first physical page used for code and data
-    yarvs::DoubleWord data_ppn = yarvs::Memory::kPhysMemAmount / (4 * yarvs::Memory::kPageSize);
+    yarvs::DoubleWord data_ppn = first_data_ppn;
 
     // Map addresses of virtual pages to addresses of physical pages for the given ELF
     std::map<yarvs::DoubleWord, yarvs::DoubleWord> va_to_pa;
-    for (const auto [page, rwx] : loadable_pages_to_flags(elf, stack_top, stack_pages_count))
+    for (const auto [page, rwx] : pages)
     {
         const yarvs::VirtualAddress va = page;
         auto a = kRootPageTablePPN * yarvs::Memory::kPageSize;
@@ -118,6 +151,8 @@ void initialize_hart(yarvs::Hart &hart, const std::filesystem::path &elf_path,
                 a = pte.get_whole_ppn();
             else
             {
+                if (table_ppn == first_data_ppn)
+                    throw too_small();
                 pte = kPointerToNextLevelPTE;
                 pte.set_ppn(table_ppn);
                 [[maybe_unused]] auto res = hart.memory().store(pa, +pte);
@@ -153,9 +188,21 @@ void initialize_hart(yarvs::Hart &hart, const std::filesystem::path &elf_path,
         const auto v_page = yarvs::mask_bits<63, yarvs::Memory::kPageBits>(seg.virtual_address);
         const auto pa = va_to_pa.at(v_page) |
                         yarvs::mask_bits<yarvs::Memory::kPageBits - 1, 0>(seg.virtual_address);
-        hart.memory().store(pa, seg.data, seg.data + seg.file_size);
+        if (!hart.memory().store(pa, seg.data, seg.data + seg.file_size))
+            throw std::runtime_error{fmt::format("failed to load segment {} at physical address "
+                                                 "{:#x}", i, pa)};
+
+        if (predecode && (seg.flags & yarvs::ELFLoader::kExecute))
+            hart.predecode(seg.virtual_address, pa, {seg.data, seg.file_size});
     }
 
+    if (predecode)
+        hart.recover_cfg(elf.get_entry());
+
+    // The user ISA profile has no trap handlers: the simulation stops with the same status
+    if constexpr (yarvs::kUserISA)
+        return;
+
     // Set exception handler
     //
     // The address of the trap vector in not placed in the translation tree, because exceptions are
@@ -163,7 +210,7 @@ void initialize_hart(yarvs::Hart &hart, const std::filesystem::path &elf_path,
     constexpr yarvs::DoubleWord kTrapBaseAddress = 0;
     constexpr std::array<uint32_t, 4> kDefaultExceptionHandler = {
         0x34201573, // csrrw x10, mcause, x0
-        0x06450513, // addi x10, x10, 100
+        0x06450513, // addi x10, x10, 100 (Hart::kExceptionStatusBase)
         0x05d00893, // addi x17, x0, 93
         0x00000073  // ecall
     };
@@ -171,8 +218,9 @@ void initialize_hart(yarvs::Hart &hart, const std::filesystem::path &elf_path,
     yarvs::XTVec mtvec;
     mtvec.set_base(kTrapBaseAddress);
     hart.csrs().set_mtvec(mtvec);
-    hart.memory().store(kTrapBaseAddress, kDefaultExceptionHandler.begin(),
-                        kDefaultExceptionHandler.end());
+    if (!hart.memory().store(kTrapBaseAddress, kDefaultExceptionHandler.begin(),
+                             kDefaultExceptionHandler.end()))
+        throw std::runtime_error{"failed to load the exception handler"};
 }
 
 } // unnamed namespace
@@ -201,6 +249,41 @@ int main(int argc, char **argv) try
         ->check(CLI::PositiveNumber)
         ->default_val(4);
 
+    std::size_t bb_cache_capacity;
+    app.add_option("--bb-cache-capacity", bb_cache_capacity,
+                   "The number of basic blocks the translation cache holds (a power of 2)")
+        ->check(kPowerOfTwo)
+        ->default_val(yarvs::Hart::kDefaultCacheCapacity);
+
+    bool jit = false;
+    app.add_flag("--jit", jit, "Translate hot basic blocks into native code (x86-64 hosts only)");
+
+    yarvs::MemoryOptions mem_options;
+    std::size_t mem_size_mb;
+    app.add_option("--memory-size", mem_size_mb, "Size of guest physical memory in MB; host "
+                                                  "memory is committed as the guest touches it")
+        ->check(CLI::PositiveNumber)
+        ->default_val(yarvs::MemoryOptions::kDefaultPhysMemSize >> 20);
+
+    app.add_flag("--fastmem", mem_options.fastmem,
+                 "Map guest pages into a host view of the address space "
+                 "(Linux hosts and the Sv39 mode only)");
+
+    bool predecode = false;
+    app.add_flag("--predecode", predecode,
+                 "Decode executable segments at load time instead of on first execution");
+
+    yarvs::Hart::TierThresholds tier_thresholds;
+    app.add_option("--decode-threshold", tier_thresholds.decoded,
+                   "The number of executions after which a block is decoded and cached")
+        ->check(CLI::PositiveNumber)
+        ->default_val(tier_thresholds.decoded);
+    app.add_option("--jit-threshold", tier_thresholds.native,
+                   "The number of executions of a cached block after which it's translated")
+        ->check(CLI::PositiveNumber)
+        ->default_val(tier_thresholds.native)
+        ->needs("--jit");
+
     auto *need_logging = app.add_flag("--log", "Enable logging");
 
     std::string log_file_name;
@@ -222,7 +305,10 @@ int main(int argc, char **argv) try
             std::unreachable();
     }();
 
-    yarvs::Hart hart;
+    mem_options.phys_mem_size = mem_size_mb << 20;
+    yarvs::Hart hart{bb_cache_capacity, mem_options};
+    hart.set_jit(jit);
+    hart.set_tier_thresholds(tier_thresholds);
 
     if (*need_logging)
     {
@@ -230,7 +316,7 @@ int main(int argc, char **argv) try
         hart.set_log_file(log_file_name);
     }
 
-    initialize_hart(hart, elf_path, translation_mode, stack_pages_count);
+    initialize_hart(hart, elf_path, translation_mode, stack_pages_count, predecode);
 
     auto start = std::chrono::high_resolution_clock::now();
     auto instr_count = hart.run();
@@ -240,9 +326,50 @@ int main(int argc, char **argv) try
     auto time = std::chrono::duration_cast<mcs>(finish - start).count();
 
     if (perf)
+    {
         fmt::println("Executed {} instructions in {} mcs.\nPerformance: {:.2f} MIPS",
                      instr_count, time, static_cast<double>(instr_count) / time);
 
+        fmt::println("Physical memory: {} MB resident of {} MB",
+                     hart.memory().resident_size() >> 20, hart.memory().phys_mem_size() >> 20);
+
+        const auto tlb_hits = hart.memory().tlb_hits();
+        const auto tlb_misses = hart.memory().tlb_misses();
+        fmt::println("TLB: {} hits, {} misses (hit rate {:.2f}%)", tlb_hits, tlb_misses,
+                     100.0 * tlb_hits / std::max<std::uintmax_t>(tlb_hits + tlb_misses, 1));
+
+        // walks start at the lowest cached table: the hit rates of the levels add up
+        const auto &mem = hart.memory();
+        std::uintmax_t n_walks = mem.walk_cache_misses();
+        for (std::size_t level = 0; level != yarvs::kNWalkCacheLevels; ++level)
+            n_walks += mem.walk_cache_hits(level);
+        fmt::print("Page walk cache: {} walks, hit rate by level", n_walks);
+        for (std::size_t level = 0; level != yarvs::kNWalkCacheLevels; ++level)
+            fmt::print(" L{} {:.2f}%", level, 100.0 * mem.walk_cache_hits(level) /
+                                              std::max<std::uintmax_t>(n_walks, 1));
+        fmt::println("");
+
+        const auto bb_hits = hart.bb_cache_hits();
+        const auto bb_misses = hart.bb_cache_misses();
+        fmt::println("Basic block cache: {} hits, {} misses, {} evictions, {} flushes "
+                     "(hit rate {:.2f}%)", bb_hits, bb_misses, hart.bb_cache_evictions(),
+                     hart.bb_cache_flushes(),
+                     100.0 * bb_hits / std::max<std::uintmax_t>(bb_hits + bb_misses, 1));
+        fmt::println("Chained block transitions: {}", hart.bb_chain_hits());
+
+        using enum yarvs::Hart::Tier;
+        fmt::println("Block executions: {} interpreted, {} decoded, {} native",
+                     hart.tier_executions(kInterpreted), hart.tier_executions(kDecoded),
+                     hart.tier_executions(kNative));
+
+        if (const auto &code = hart.predecoded_code(); !code.empty())
+            fmt::println("Predecoded code: {} basic blocks found", code.n_blocks());
+
+        if (const auto *jit = hart.jit())
+            fmt::println("JIT: {} blocks translated into {} bytes of code",
+                         jit->translated_blocks(), jit->code_size());
+    }
+
     return hart.get_status();
 }
 catch (const std::exception &e)
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "yarvs/common.hpp"
+#include "yarvs/decoder.hpp"
+#include "yarvs/instruction.hpp"
+#include "yarvs/predecoded_code.hpp"
+
+#include "yarvs/memory/memory.hpp"
+
+namespace yarvs
+{
+
+void PredecodedCode::add_segment(DoubleWord va, DoubleWord pa, std::span<const Byte> code)
+{
+    if (va % sizeof(RawInstruction) != 0 || va % Memory::kPageSize != pa % Memory::kPageSize)
+        throw std::invalid_argument{"predecoded segment is misaligned"};
+
+    Segment segment{.va = va, .first_ppn = pa / Memory::kPageSize};
+
+    const auto n_instrs = code.size() / sizeof(RawInstruction);
+    std::vector<RawInstruction> raw_instrs(n_instrs);
+    for (std::size_t i = 0; i != n_instrs; ++i)
+        for (std::size_t byte = 0; byte != sizeof(RawInstruction); ++byte)
+            raw_instrs[i] |= RawInstruction{code[i * sizeof(RawInstruction) + byte]} << (8 * byte);
+    Decoder::decode_bulk(raw_instrs, segment.instrs);
+
+    segment.leaders.resize(n_instrs);
+
+    const auto n_pages = (va % Memory::kPageSize + code.size() + Memory::kPageSize - 1)
+                       / Memory::kPageSize;
+    segment.valid_pages.resize(n_pages, true);
+
+    segments_.push_back(std::move(segment));
+}
+
+void PredecodedCode::recover_cfg(DoubleWord entry)
+{
+    std::vector<DoubleWord> worklist;
+    auto add_leader = [this, &worklist](DoubleWord va)
+    {
+        auto *segment = segment_of(va);
+        if (!segment || va % sizeof(RawInstruction) != 0)
+            return;
+        const auto i = (va - segment->va) / sizeof(RawInstruction);
+        if (!segment->leaders[i])
+        {
+            segment->leaders[i] = true;
+            worklist.push_back(va);
+        }
+    };
+
+    add_leader(entry);
+    while (!worklist.empty())
+    {
+        DoubleWord va = worklist.back();
+        worklist.pop_back();
+
+        const auto *segment = segment_of(va);
+        for (auto i = (va - segment->va) / sizeof(RawInstruction);
+             i != segment->instrs.size(); ++i, va += sizeof(RawInstruction))
+        {
+            const auto instr = segment->instrs[i];
+            if (!instr.is_terminator())
+                continue;
+
+            if (instr.is_direct_jump())
+                add_leader(va + instr.imm);
+
+            switch (instr.id)
+            {
+                case InstrID::kJAL:
+                case InstrID::kJALR:
+                    if (instr.rd != 0) // a call returns to the next instruction
+                        add_leader(va + sizeof(RawInstruction));
+                    break;
+#ifndef YARVS_USER_ISA
+                case InstrID::kMRET:
+                case InstrID::kSRET:
+                    break;
+#endif
+                default:
+                    add_leader(va + sizeof(RawInstruction));
+                    break;
+            }
+            break;
+        }
+    }
+}
+
+std::size_t PredecodedCode::block_size(DoubleWord va) const noexcept
+{
+    const auto *segment = segment_of(va);
+    if (!segment)
+        return 0;
+
+    const auto first = (va - segment->va) / sizeof(RawInstruction);
+    if (!segment->leaders[first])
+        return 0;
+
+    for (auto i = first; i != segment->instrs.size(); ++i)
+    {
+        if (i != first && segment->leaders[i])
+            return i - first;
+        if (segment->instrs[i].is_terminator())
+            return i + 1 - first;
+    }
+    return segment->instrs.size() - first;
+}
+
+void PredecodedCode::invalidate_pages(std::span<const DoubleWord> ppns) noexcept
+{
+    for (auto &segment : segments_)
+        for (const auto ppn : ppns)
+            if (segment.first_ppn <= ppn && ppn - segment.first_ppn < segment.valid_pages.size())
+                segment.valid_pages[ppn - segment.first_ppn] = false;
+}
+
+std::size_t PredecodedCode::n_blocks() const noexcept
+{
+    std::size_t n_blocks = 0;
+    for (const auto &segment : segments_)
+        n_blocks += std::ranges::count(segment.leaders, true);
+    return n_blocks;
+}
+
+const PredecodedCode::Segment *PredecodedCode::segment_of(DoubleWord va) const noexcept
+{
+    auto segment = std::ranges::find_if(segments_, [va](const Segment &segment)
+    {
+        return va - segment.va < segment.instrs.size() * sizeof(RawInstruction);
+    });
+    return (segment != segments_.end()) ? &*segment : nullptr;
+}
+
+} // namespace yarvs
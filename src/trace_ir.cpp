@@ -0,0 +1,235 @@
+#include <array>
+#include <cstddef>
+#include <optional>
+
+#include "yarvs/bits_manipulation.hpp"
+#include "yarvs/common.hpp"
+#include "yarvs/decoder.hpp"
+#include "yarvs/instruction.hpp"
+#include "yarvs/reg_file.hpp"
+
+#include "yarvs/jit/trace_ir.hpp"
+
+namespace yarvs
+{
+
+namespace
+{
+
+constexpr DoubleWord sext_word(DoubleWord value) noexcept
+{
+    return sext<32, DoubleWord>(static_cast<Word>(value));
+}
+
+// the direction of a conditional branch if its operands are known
+std::optional<bool> evaluate_branch(InstrID id, std::optional<DoubleWord> rs1,
+                                    std::optional<DoubleWord> rs2) noexcept
+{
+    if (!rs1 || !rs2)
+        return std::nullopt;
+
+    const auto lhs = *rs1;
+    const auto rhs = *rs2;
+    switch (id)
+    {
+        case InstrID::kBEQ: return lhs == rhs;
+        case InstrID::kBNE: return lhs != rhs;
+        case InstrID::kBLT: return to_signed(lhs) < to_signed(rhs);
+        case InstrID::kBGE: return to_signed(lhs) >= to_signed(rhs);
+        case InstrID::kBLTU: return lhs < rhs;
+        case InstrID::kBGEU: return lhs >= rhs;
+        case InstrID::kSLT_BNEZ: return to_signed(lhs) < to_signed(rhs);
+        case InstrID::kSLT_BEQZ: return !(to_signed(lhs) < to_signed(rhs));
+        case InstrID::kSLTU_BNEZ: return lhs < rhs;
+        case InstrID::kSLTU_BEQZ: return !(lhs < rhs);
+        default: return std::nullopt;
+    }
+}
+
+} // unnamed namespace
+
+bool TraceIR::is_pure(InstrID id) noexcept
+{
+    switch (id)
+    {
+        case InstrID::kADD: case InstrID::kSUB: case InstrID::kAND: case InstrID::kOR:
+        case InstrID::kXOR: case InstrID::kSLT: case InstrID::kSLTU: case InstrID::kSLL:
+        case InstrID::kSRL: case InstrID::kSRA:
+        case InstrID::kADDW: case InstrID::kSUBW: case InstrID::kSLLW: case InstrID::kSRLW:
+        case InstrID::kSRAW:
+        case InstrID::kADDI: case InstrID::kANDI: case InstrID::kORI: case InstrID::kXORI:
+        case InstrID::kSLTI: case InstrID::kSLTIU: case InstrID::kSLLI: case InstrID::kSRLI:
+        case InstrID::kSRAI:
+        case InstrID::kADDIW: case InstrID::kSLLIW: case InstrID::kSRLIW: case InstrID::kSRAIW:
+        case InstrID::kLUI: case InstrID::kAUIPC:
+        case InstrID::kLUI_ADDI: case InstrID::kLUI_ADDIW: case InstrID::kSLLI_SRLI:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// mirrors the interpreter (see executor.cpp) exactly, including shift amounts of word instructions
+std::optional<DoubleWord> TraceIR::evaluate(const Instruction &instr, DoubleWord pc,
+                                            std::optional<DoubleWord> rs1,
+                                            std::optional<DoubleWord> rs2) noexcept
+{
+    switch (instr.id)
+    {
+        case InstrID::kLUI:
+        case InstrID::kLUI_ADDI:
+        case InstrID::kLUI_ADDIW:
+            return instr.imm;
+        case InstrID::kAUIPC:
+            return pc + instr.imm;
+        default:
+            break;
+    }
+
+    if (!rs1)
+        return std::nullopt;
+    const auto lhs = *rs1;
+    const DoubleWord imm = instr.imm; // sign-extended
+
+    switch (instr.id)
+    {
+        case InstrID::kADDI: return lhs + imm;
+        case InstrID::kANDI: return lhs & imm;
+        case InstrID::kORI: return lhs | imm;
+        case InstrID::kXORI: return lhs ^ imm;
+        case InstrID::kSLTI: return to_signed(lhs) < to_signed(imm);
+        case InstrID::kSLTIU: return lhs < imm;
+        case InstrID::kSLLI: return lhs << mask_bits<5, 0>(imm);
+        case InstrID::kSRLI: return lhs >> mask_bits<5, 0>(imm);
+        case InstrID::kSRAI: return to_unsigned(to_signed(lhs) >> mask_bits<5, 0>(imm));
+        case InstrID::kADDIW: return sext_word(lhs + imm);
+        case InstrID::kSLLIW: return sext_word(lhs << mask_bits<5, 0>(imm));
+        case InstrID::kSRLIW: return sext_word(static_cast<Word>(lhs) >> mask_bits<4, 0>(imm));
+        case InstrID::kSRAIW:
+            return sext_word(to_signed(static_cast<Word>(lhs)) >> mask_bits<4, 0>(imm));
+        case InstrID::kSLLI_SRLI: return (lhs << imm) >> imm;
+        default:
+            break;
+    }
+
+    if (!rs2)
+        return std::nullopt;
+    const auto rhs = *rs2;
+
+    switch (instr.id)
+    {
+        case InstrID::kADD: return lhs + rhs;
+        case InstrID::kSUB: return lhs - rhs;
+        case InstrID::kAND: return lhs & rhs;
+        case InstrID::kOR: return lhs | rhs;
+        case InstrID::kXOR: return lhs ^ rhs;
+        case InstrID::kSLT: return to_signed(lhs) < to_signed(rhs);
+        case InstrID::kSLTU: return lhs < rhs;
+        case InstrID::kSLL: return lhs << mask_bits<5, 0>(rhs);
+        case InstrID::kSRL: return lhs >> mask_bits<5, 0>(rhs);
+        case InstrID::kSRA: return to_unsigned(to_signed(lhs) >> mask_bits<5, 0>(rhs));
+        case InstrID::kADDW: return sext_word(lhs + rhs);
+        case InstrID::kSUBW: return sext_word(lhs - rhs);
+        case InstrID::kSLLW: return sext_word(lhs << mask_bits<4, 0>(rhs));
+        case InstrID::kSRLW: return sext_word(static_cast<Word>(lhs) >> mask_bits<4, 0>(rhs));
+        case InstrID::kSRAW:
+            return sext_word(to_signed(static_cast<Word>(lhs)) >> mask_bits<4, 0>(rhs));
+        default:
+            return std::nullopt;
+    }
+}
+
+void TraceIR::propagate_constants()
+{
+    std::array<std::optional<DoubleWord>, RegFile::kNRegs> known;
+    known[0] = 0;
+
+    auto set = [&known](std::size_t i, std::optional<DoubleWord> value)
+    {
+        if (i != 0)
+            known[i] = value;
+    };
+
+    for (auto &node : nodes_)
+    {
+        const auto &instr = *node.instr;
+        node.rs1_value = known[instr.rs1];
+        node.rs2_value = known[instr.rs2];
+
+        if (is_pure(instr.id))
+        {
+            node.result = evaluate(instr, node.pc, node.rs1_value, node.rs2_value);
+            set(instr.rd, node.result);
+            continue;
+        }
+
+        node.taken = evaluate_branch(instr.id, node.rs1_value, node.rs2_value);
+
+        const DoubleWord fall_through_pc = node.pc + instr.length() * sizeof(RawInstruction);
+        switch (instr.id)
+        {
+            case InstrID::kJAL:
+            case InstrID::kJALR:
+                set(instr.rd, fall_through_pc);
+                break;
+            case InstrID::kAUIPC_JALR:
+                set(instr.rs1, node.pc + Decoder::fused_auipc_imm(instr));
+                set(instr.rd, fall_through_pc);
+                break;
+            case InstrID::kAUIPC_LD:
+                set(instr.rs1, node.pc + Decoder::fused_auipc_imm(instr));
+                set(instr.rd, std::nullopt);
+                break;
+            case InstrID::kSLT_BNEZ:
+            case InstrID::kSLT_BEQZ:
+            case InstrID::kSLTU_BNEZ:
+            case InstrID::kSLTU_BEQZ:
+            {
+                std::optional<DoubleWord> set_value;
+                if (node.taken)
+                    set_value = (*node.taken == (instr.id == InstrID::kSLT_BNEZ ||
+                                                 instr.id == InstrID::kSLTU_BNEZ));
+                set(instr.rd, set_value);
+                break;
+            }
+            case InstrID::kECALL: // system calls return values in registers
+                known.fill(std::nullopt);
+                known[0] = 0;
+                break;
+            default: // rd is 0 for instructions not writing a register
+                set(instr.rd, std::nullopt);
+                break;
+        }
+    }
+}
+
+void TraceIR::eliminate_dead_writes()
+{
+    std::array<bool, RegFile::kNRegs> live;
+    live.fill(true); // the trace is left with all the registers
+
+    for (auto node = nodes_.rbegin(); node != nodes_.rend(); ++node)
+    {
+        const auto &instr = *node->instr;
+        if (!is_pure(instr.id))
+        {
+            live.fill(true);
+            continue;
+        }
+
+        if (instr.rd == 0 || !live[instr.rd])
+        {
+            node->dead = true;
+            continue;
+        }
+
+        live[instr.rd] = false;
+        if (!node->result) // a folded result doesn't need operands
+        {
+            live[instr.rs1] = true;
+            live[instr.rs2] = true;
+        }
+    }
+}
+
+} // namespace yarvs
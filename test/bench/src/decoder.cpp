@@ -0,0 +1,108 @@
+#include <array>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "yarvs/common.hpp"
+#include "yarvs/decoder.hpp"
+#include "yarvs/instruction_buffer.hpp"
+
+using namespace yarvs;
+
+namespace
+{
+
+constexpr std::size_t kNInstrs = 4096;
+constexpr std::size_t kNSegmentInstrs = 1 << 20; // a 4MB text segment
+
+// instructions of all formats with zero register fields
+constexpr std::array<RawInstruction, 16> kTemplates = {
+    0b0000000'00000'00000'000'00000'0110011, // add
+    0b0100000'00000'00000'000'00000'0110011, // sub
+    0b0100000'00000'00000'101'00000'0110011, // sra
+    0b0000000'00000'00000'000'00000'0111011, // addw
+    0b000000000001'00000'000'00000'0010011,  // addi 1
+    0b000000'000011'00000'001'00000'0010011, // slli 3
+    0b010000'000011'00000'101'00000'0010011, // srai 3
+    0b000000001000'00000'011'00000'0000011,  // ld 8
+    0b000000001000'00000'010'00000'0000011,  // lw 8
+    0b0000000'00000'00000'011'01000'0100011, // sd 8
+    0b1111111'00000'00000'001'11001'1100011, // bne -8
+    0b0000000'00000'00000'100'01000'1100011, // blt 8
+    0b00010010001101000101'00000'0110111,    // lui 0x12345
+    0b00000000000000000001'00000'0010111,    // auipc 1
+    0b00000001000000000000'00000'1101111,    // jal 16
+    0b000000000000'00000'000'00000'1100111   // jalr 0
+};
+
+// a random sequence of valid instructions with random registers
+std::vector<RawInstruction> make_instructions(std::size_t n_instrs = kNInstrs)
+{
+    std::mt19937 gen{42};
+    std::uniform_int_distribution<std::size_t> instr_dist{0, kTemplates.size() - 1};
+    std::uniform_int_distribution<RawInstruction> reg_dist{0, 31};
+
+    std::vector<RawInstruction> instrs(n_instrs);
+    for (auto &instr : instrs)
+        instr = kTemplates[instr_dist(gen)] | (reg_dist(gen) << 7) | (reg_dist(gen) << 15)
+                                            | (reg_dist(gen) << 20);
+    return instrs;
+}
+
+// random words: most of them are illegal instructions
+std::vector<RawInstruction> make_words()
+{
+    std::mt19937 gen{42};
+    std::vector<RawInstruction> words(kNInstrs);
+    for (auto &word : words)
+        word = gen();
+    return words;
+}
+
+void decode(benchmark::State &state, const std::vector<RawInstruction> &raws)
+{
+    for (auto _ : state)
+        for (const auto raw : raws)
+            benchmark::DoNotOptimize(Decoder::decode(raw));
+    state.SetItemsProcessed(state.iterations() * raws.size());
+}
+
+void decode_instructions(benchmark::State &state) { decode(state, make_instructions()); }
+void decode_random_words(benchmark::State &state) { decode(state, make_words()); }
+
+// decoding of a whole text segment into the same buffer as predecoding does
+void decode_segment_scalar(benchmark::State &state)
+{
+    const auto raws = make_instructions(kNSegmentInstrs);
+    InstructionBuffer buffer;
+    buffer.resize(raws.size());
+    for (auto _ : state)
+    {
+        for (std::size_t i = 0; i != raws.size(); ++i)
+            buffer.set(i, Decoder::decode(raws[i]));
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * raws.size());
+}
+
+void decode_segment_bulk(benchmark::State &state)
+{
+    const auto raws = make_instructions(kNSegmentInstrs);
+    InstructionBuffer buffer;
+    for (auto _ : state)
+    {
+        buffer.clear();
+        Decoder::decode_bulk(raws, buffer);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * raws.size());
+}
+
+} // unnamed namespace
+
+BENCHMARK(decode_instructions);
+BENCHMARK(decode_random_words);
+BENCHMARK(decode_segment_scalar);
+BENCHMARK(decode_segment_bulk);
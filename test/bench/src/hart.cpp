@@ -0,0 +1,57 @@
+#include <array>
+#include <cstddef>
+
+#include <benchmark/benchmark.h>
+
+#include "yarvs/common.hpp"
+#include "yarvs/hart.hpp"
+
+using namespace yarvs;
+
+namespace
+{
+
+constexpr DoubleWord kEntry = 0x10000;
+constexpr DoubleWord kStackTop = 0x20000;
+
+// sums 65536 numbers spilling the sum to the stack and exits
+constexpr std::array<RawInstruction, 9> kLoop = {
+    0b00000000000000010000'00101'0110111,     // lui x5, 0x10
+    0b0000000'00101'00110'000'00110'0110011,  // add x6, x6, x5
+    0b0000000'00110'00010'011'00000'0100011,  // sd x6, 0(sp)
+    0b000000000000'00010'011'00110'0000011,   // ld x6, 0(sp)
+    0b111111111111'00101'000'00101'0010011,   // addi x5, x5, -1
+    0b1111111'00000'00101'001'10001'1100011,  // bne x5, x0, -16
+    0b000001011101'00000'000'10001'0010011,   // addi x17, x0, 93
+    0b000000000000'00000'000'01010'0010011,   // addi x10, x0, 0
+    0b000000000000'00000'000'00000'1110011    // ecall
+};
+
+void construct_hart(benchmark::State &state)
+{
+    for (auto _ : state)
+    {
+        Hart hart;
+        benchmark::DoNotOptimize(hart);
+    }
+}
+
+void run_loop(benchmark::State &state)
+{
+    Hart hart;
+    hart.memory().store(kEntry, kLoop.begin(), kLoop.end());
+    hart.gprs().set_reg(Hart::kSP, kStackTop);
+
+    std::size_t n_instrs = 0;
+    for (auto _ : state)
+    {
+        hart.set_pc(kEntry);
+        n_instrs += hart.run();
+    }
+    state.SetItemsProcessed(n_instrs);
+}
+
+} // unnamed namespace
+
+BENCHMARK(construct_hart);
+BENCHMARK(run_loop);
@@ -0,0 +1,41 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <span>
+
+#include <gtest/gtest.h>
+
+#include "yarvs/cache/arena.hpp"
+
+using namespace yarvs;
+
+TEST(ArenaTest, Allocation)
+{
+    Arena arena{64};
+
+    constexpr std::array<std::uint8_t, 3> kBytes = {1, 2, 3};
+    constexpr std::array<std::uint64_t, 2> kWords = {4, 5};
+
+    const auto bytes = arena.copy<std::uint8_t>(kBytes);
+    ASSERT_EQ(bytes.size(), kBytes.size());
+    EXPECT_TRUE(std::ranges::equal(bytes, kBytes));
+
+    // the words are aligned and placed right after the bytes
+    const auto words = arena.copy<std::uint64_t>(kWords);
+    ASSERT_EQ(words.size(), kWords.size());
+    EXPECT_TRUE(std::ranges::equal(words, kWords));
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(words.data()) % alignof(std::uint64_t), 0);
+    EXPECT_LE(reinterpret_cast<const std::uint8_t *>(words.data()) - bytes.data(),
+              Arena::footprint<std::uint64_t>(1));
+    EXPECT_EQ(arena.size(), 8 + sizeof(kWords));
+
+    // 24 bytes of 64 are taken: there's space for 5 words only
+    constexpr std::array<std::uint64_t, 6> kMoreWords{};
+    EXPECT_TRUE(arena.copy<std::uint64_t>(kMoreWords).empty());
+    EXPECT_EQ(arena.size(), 8 + sizeof(kWords));
+    EXPECT_EQ(arena.copy<std::uint64_t>(std::span{kMoreWords}.first(5)).size(), 5);
+    EXPECT_EQ(arena.available(), 0);
+
+    arena.clear();
+    EXPECT_EQ(arena.copy<std::uint64_t>(kMoreWords).size(), kMoreWords.size());
+}
@@ -0,0 +1,50 @@
+#include <cstddef>
+#include <ios>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "yarvs/common.hpp"
+#include "yarvs/decoder.hpp"
+#include "yarvs/instruction_buffer.hpp"
+
+using namespace yarvs;
+
+TEST(DecoderTest, BulkDecoding)
+{
+    // random words cover illegal encodings; legal ones are forced by setting the low opcode bits
+    std::mt19937 gen{42};
+    std::vector<RawInstruction> raw_instrs(1003); // not a multiple of the vector width
+    for (std::size_t i = 0; i != raw_instrs.size(); ++i)
+        raw_instrs[i] = (i % 2) ? gen() : (gen() | 0b11);
+
+    InstructionBuffer buffer;
+    buffer.push_back(Decoder::decode(0x00000013)); // decode_bulk appends
+    Decoder::decode_bulk(raw_instrs, buffer);
+    ASSERT_EQ(buffer.size(), raw_instrs.size() + 1);
+
+    for (std::size_t i = 0; i != raw_instrs.size(); ++i)
+    {
+        const auto expected = Decoder::decode(raw_instrs[i]);
+        const auto actual = buffer[i + 1];
+
+        SCOPED_TRACE(testing::Message() << "raw instruction " << std::hex << raw_instrs[i]);
+        EXPECT_EQ(actual.handler, expected.handler);
+        EXPECT_EQ(actual.id, expected.id);
+        EXPECT_EQ(actual.rs1, expected.rs1);
+        EXPECT_EQ(actual.rs2, expected.rs2);
+        EXPECT_EQ(actual.rd, expected.rd);
+        EXPECT_EQ(actual.imm, expected.imm);
+    }
+}
+
+TEST(DecoderTest, Encoding)
+{
+    std::mt19937 gen{42};
+    for (int i = 0; i != 10000; ++i)
+    {
+        const RawInstruction raw_instr = gen() | 0b11;
+        EXPECT_EQ(Decoder::decode(raw_instr).encode(), raw_instr) << std::hex << raw_instr;
+    }
+}
@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <array>
 #include <ranges>
+#include <utility>
 
 #include <fmt/format.h>
 
@@ -7,8 +9,13 @@
 
 #include "yarvs/common.hpp"
 #include "yarvs/hart.hpp"
+#include "yarvs/instruction.hpp"
 #include "yarvs/reg_file.hpp"
 
+#include "yarvs/privileged/xtvec.hpp"
+
+#include "yarvs/privileged/machine/mcause.hpp"
+
 using namespace yarvs;
 
 class ExecutorTest : public testing::Test
@@ -467,6 +474,29 @@ TEST_F(ExecutorTest, Store_DoubleWord)
     EXPECT_EQ(hart.memory().load<DoubleWord>(kAddr + 32 + sizeof(DoubleWord)), kValues[3]);
 }
 
+// word shifts operate on the low 32 bits of rs1 and sign-extend the 32-bit result
+TEST_F(ExecutorTest, WordShifts)
+{
+    constexpr std::array<RawInstruction, 4> kInstructions = {
+        0b0000000'00010'00001'101'00011'0111011, // srlw x3, x1, x2
+        0b0100000'00010'00001'101'00100'0111011, // sraw x4, x1, x2
+        0b0000000'00100'00001'101'00101'0011011, // srliw x5, x1, 4
+        0b0100000'00100'00001'101'00110'0011011  // sraiw x6, x1, 4
+    };
+
+    add_instructions(kInstructions);
+
+    hart.gprs().set_reg(1, 0x12345678'f0000000);
+    hart.gprs().set_reg(2, 32 + 4); // only rs2[4:0] is the shift amount
+
+    hart.run();
+
+    EXPECT_EQ(hart.gprs().get_reg(3), 0x0f000000);
+    EXPECT_EQ(hart.gprs().get_reg(4), 0xffffffff'ff000000);
+    EXPECT_EQ(hart.gprs().get_reg(5), 0x0f000000);
+    EXPECT_EQ(hart.gprs().get_reg(6), 0xffffffff'ff000000);
+}
+
 TEST_F(ExecutorTest, Auipc)
 {
     constexpr std::array<RawInstruction, 2> kInstructions = {
@@ -508,3 +538,211 @@ TEST_F(ExecutorTest, Lui)
 
     EXPECT_EQ(hart.get_pc(), kEntry + kInstructions.size() * kInstrSize);
 }
+
+// pairs of instructions executed repeatedly are fused in cached blocks
+TEST_F(ExecutorTest, FusedPairs)
+{
+    constexpr DoubleWord kIterations = 8;
+    constexpr DoubleWord kData = 0x0123456789abcdef;
+    constexpr std::array<RawInstruction, 14> kInstructions = {
+        0b00010010001101000101'01010'0110111,    // lui x10, 0x12345
+        0b011001111000'01010'000'01010'0010011,  // addi x10, x10, 0x678
+        0b10000000000000000000'01011'0110111,    // lui x11, 0x80000
+        0b111111111111'01011'000'01011'0011011,  // addiw x11, x11, -1
+        0b000000'100000'01111'001'01100'0010011, // slli x12, x15, 32
+        0b000000'100000'01100'101'01100'0010011, // srli x12, x12, 32
+        0b00000000000000000000'01101'0010111,    // auipc x13, 0
+        0b000001000000'01101'011'01110'0000011,  // ld x14, 64(x13)
+        0b00000000000000000000'00001'0010111,    // auipc x1, 0
+        0b000000001100'00001'000'00001'1100111,  // jalr x1, 12(x1)
+        0b000000000001'00111'000'00111'0010011,  // addi x7, x7, 1
+        0b111111111111'00101'000'00101'0010011,  // addi x5, x5, -1
+        0b0000000'00101'00000'010'00110'0110011, // slt x6, x0, x5
+        0b1111110'00000'00110'001'01101'1100011  // bne x6, x0, -52
+    };
+
+    add_instructions(kInstructions);
+    hart.memory().store(kEntry + 6 * kInstrSize + 64, kData);
+
+    hart.gprs().set_reg(5, kIterations);
+    hart.gprs().set_reg(15, 0xfedcba9876543210);
+
+    // addi x7, x7, 1 is skipped
+    EXPECT_EQ(hart.run(), kIterations * (kInstructions.size() - 1) + 1);
+
+    EXPECT_EQ(hart.gprs().get_reg(1), kEntry + 10 * kInstrSize);
+    EXPECT_EQ(hart.gprs().get_reg(5), 0);
+    EXPECT_EQ(hart.gprs().get_reg(6), 0);
+    EXPECT_EQ(hart.gprs().get_reg(7), 0);
+    EXPECT_EQ(hart.gprs().get_reg(10), 0x12345678);
+    EXPECT_EQ(hart.gprs().get_reg(11), 0x7fffffff);
+    EXPECT_EQ(hart.gprs().get_reg(12), 0x76543210);
+    EXPECT_EQ(hart.gprs().get_reg(13), kEntry + 6 * kInstrSize);
+    EXPECT_EQ(hart.gprs().get_reg(14), kData);
+
+    EXPECT_EQ(hart.get_pc(), kEntry + kInstructions.size() * kInstrSize);
+
+    // the pairs have been executed fused, as single instructions of the cached blocks
+    auto cached_fused = [this](DoubleWord pc, InstrID id)
+    {
+        const auto block = hart.cached_block(pc);
+        const auto instr = std::ranges::find(block, id, &Instruction::id);
+        return instr != block.end() && instr->length() == 2;
+    };
+
+    EXPECT_TRUE(cached_fused(kEntry, InstrID::kLUI_ADDI));
+    EXPECT_TRUE(cached_fused(kEntry, InstrID::kLUI_ADDIW));
+    EXPECT_TRUE(cached_fused(kEntry, InstrID::kSLLI_SRLI));
+    EXPECT_TRUE(cached_fused(kEntry, InstrID::kAUIPC_LD));
+    EXPECT_TRUE(cached_fused(kEntry, InstrID::kAUIPC_JALR));
+    EXPECT_TRUE(cached_fused(kEntry + 11 * kInstrSize, InstrID::kSLT_BNEZ));
+}
+
+// forms with x0 operands have handlers of their own
+TEST_F(ExecutorTest, X0Operands)
+{
+    constexpr std::array<RawInstruction, 8> kInstructions = {
+        0b000000000101'00001'000'00000'0010011,  // addi x0, x1, 5
+        0b111111111001'00000'000'00011'0010011,  // addi x3, x0, -7
+        0b011111111111'00000'110'00100'0010011,  // ori x4, x0, 0x7ff
+        0b00000000100000000000'00000'1101111,    // jal x0, 8
+        0b000000000001'00000'000'00101'0010011,  // addi x5, x0, 1
+        0b00000000000000000000'00110'0010111,    // auipc x6, 0
+        0b000000001100'00110'000'00000'1100111,  // jalr x0, 12(x6)
+        0b000000000001'00000'000'00111'0010011   // addi x7, x0, 1
+    };
+
+    add_instructions(kInstructions);
+
+    hart.gprs().set_reg(1, 1);
+
+    // addi x5 and addi x7 are skipped, ebreak is counted
+    EXPECT_EQ(hart.run(), kInstructions.size() - 2 + 1);
+
+    EXPECT_EQ(hart.gprs().get_reg(0), 0);
+    EXPECT_EQ(hart.gprs().get_reg(3), static_cast<DoubleWord>(-7));
+    EXPECT_EQ(hart.gprs().get_reg(4), 0x7ff);
+    EXPECT_EQ(hart.gprs().get_reg(5), 0);
+    EXPECT_EQ(hart.gprs().get_reg(6), kEntry + 5 * kInstrSize);
+    EXPECT_EQ(hart.gprs().get_reg(7), 0);
+
+    EXPECT_EQ(hart.get_pc(), kEntry + kInstructions.size() * kInstrSize);
+}
+
+// stores to cached code invalidate the blocks decoded from it
+TEST_F(ExecutorTest, SelfModifyingCode)
+{
+    constexpr DoubleWord kIterations = 8;
+    constexpr RawInstruction kAddi2 = 0b000000000010'00111'000'00111'0010011; // addi x7, x7, 2
+    constexpr std::array<RawInstruction, 5> kInstructions = {
+        0b000000000001'00111'000'00111'0010011,  // addi x7, x7, 1
+        0b111111111111'00101'000'00101'0010011,  // addi x5, x5, -1
+        0b0000000'01001'00101'001'01000'1100011, // bne x5, x9, 8
+        0b0000000'01000'01010'010'00000'0100011, // sw x8, 0(x10)
+        0b1111111'00000'00101'001'10001'1100011  // bne x5, x0, -16
+    };
+
+    add_instructions(kInstructions);
+
+    hart.gprs().set_reg(5, kIterations);
+    hart.gprs().set_reg(8, kAddi2);
+    hart.gprs().set_reg(9, kIterations / 2);
+    hart.gprs().set_reg(10, kEntry);
+
+    hart.run();
+
+    EXPECT_EQ(hart.gprs().get_reg(7), kIterations / 2 * 1 + kIterations / 2 * 2);
+    EXPECT_EQ(hart.get_pc(), kEntry + kInstructions.size() * kInstrSize);
+}
+
+// CSR numbers are unsigned: the ones of 0x800 and above are not sign-extended on decoding
+TEST_F(ExecutorTest, HighCSRNumbers)
+{
+    if constexpr (kUserISA)
+        GTEST_SKIP() << "Zicsr is a part of the privileged architecture";
+
+    constexpr std::array<RawInstruction, 3> kInstructions = {
+        0b110000000000'00000'010'00101'1110011, // csrrs x5, cycle, x0
+        0b100000000000'00110'001'00000'1110011, // csrrw x0, 0x800, x6
+        0b100000000000'00000'010'00111'1110011  // csrrs x7, 0x800, x0
+    };
+
+    add_instructions(kInstructions);
+
+    hart.gprs().set_reg(5, 1);
+    hart.gprs().set_reg(6, 42);
+    hart.gprs().set_reg(7, 1);
+
+    hart.run();
+
+    // both are accessible from U mode but not implemented: they read as 0, writes are ignored
+    EXPECT_EQ(hart.gprs().get_reg(5), 0);
+    EXPECT_EQ(hart.gprs().get_reg(7), 0);
+    EXPECT_EQ(hart.get_pc(), kEntry + kInstructions.size() * kInstrSize);
+}
+
+// unknown encodings raise the illegal instruction exception instead of throwing
+// predecoded instructions, which differ from memory here, are still used after SFENCE.VMA
+TEST_F(ExecutorTest, PredecodedCodeAfterSFenceVMA)
+{
+    if constexpr (kUserISA)
+        GTEST_SKIP() << "SFENCE.VMA is a part of the privileged architecture";
+
+    constexpr DoubleWord kHandler = kEntry + kPageSize;
+    constexpr std::array<RawInstruction, 2> kInstructions = {
+        0b0001001'00000'00000'000'00000'1110011, // sfence.vma: illegal in U mode
+        0b000000000001'00111'000'00111'0010011   // addi x7, x7, 1
+    };
+    constexpr std::array<RawInstruction, 3> kPredecoded = {
+        kInstructions[0],
+        0b000000000010'00111'000'00111'0010011,  // addi x7, x7, 2
+        kEbreak
+    };
+    constexpr std::array<RawInstruction, 5> kTrapHandler = {
+        0b001101000001'00000'010'00101'1110011,  // csrrs x5, mepc, x0
+        0b000000000100'00101'000'00101'0010011,  // addi x5, x5, 4
+        0b001101000001'00101'001'00000'1110011,  // csrrw x0, mepc, x5
+        0b0001001'00000'00000'000'00000'1110011, // sfence.vma
+        0b0011000'00010'00000'000'00000'1110011  // mret
+    };
+
+    add_instructions(kInstructions);
+    hart.memory().store(kHandler, kTrapHandler.begin(), kTrapHandler.end());
+
+    XTVec mtvec;
+    mtvec.set_base(kHandler);
+    hart.csrs().set_mtvec(mtvec);
+
+    const auto *bytes = reinterpret_cast<const Byte *>(kPredecoded.data());
+    hart.predecode(kEntry, kEntry, {bytes, kPredecoded.size() * sizeof(RawInstruction)});
+
+    hart.run();
+
+    EXPECT_EQ(hart.gprs().get_reg(7), 2);
+    EXPECT_EQ(hart.get_pc(), kEntry + kInstructions.size() * kInstrSize);
+}
+
+TEST_F(ExecutorTest, IllegalInstruction)
+{
+    constexpr std::array<RawInstruction, 4> kIllegal = {
+        0x00000000,                              // all zeros
+        0b0100000'00010'00001'001'00011'0110011, // sll with funct7 of sra
+        0b000000000010'00000'000'00000'1110011,  // ecall with a nonzero imm
+        0x00004501                               // 16-bit c.li
+    };
+
+    for (const auto raw : kIllegal)
+    {
+        hart.set_pc(kEntry);
+        add_instruction(raw);
+
+        EXPECT_FALSE(hart.run_single()) << fmt::format("{:#010x}", raw);
+        EXPECT_EQ(hart.csrs().get_mcause().get_cause(),
+                  std::pair(+MCause::kIllegalInstruction, false));
+        EXPECT_EQ(hart.csrs().get_mtval(), raw);
+        EXPECT_EQ(hart.csrs().get_mepc(), kEntry);
+        if constexpr (kUserISA) // there's no trap handler
+            EXPECT_EQ(hart.get_status(),
+                      Hart::kExceptionStatusBase + int{MCause::kIllegalInstruction});
+    }
+}
@@ -0,0 +1,383 @@
+#include <array>
+#include <ranges>
+#include <utility>
+
+#include <fmt/format.h>
+
+#include <gtest/gtest.h>
+
+#include "yarvs/common.hpp"
+#include "yarvs/hart.hpp"
+#include "yarvs/reg_file.hpp"
+
+#include "yarvs/jit/jit.hpp"
+
+#include "yarvs/memory/memory.hpp"
+
+#include "yarvs/privileged/machine/mcause.hpp"
+
+#include "yarvs/privileged/supervisor/satp.hpp"
+
+#include "page_tables.hpp"
+
+using namespace yarvs;
+
+/*
+ * Programs are run both by the interpreter and with the JIT enabled. They loop long enough for
+ * their blocks to get translated, and the final states of the harts shall be the same.
+ */
+class JITTest : public testing::Test
+{
+protected:
+
+    static constexpr RawInstruction kEbreak = 0x00100073;
+    static constexpr DoubleWord kEntry = 0x42000;
+    static constexpr auto kInstrSize = sizeof(RawInstruction);
+
+    void SetUp() override
+    {
+        if (!JIT::kSupported)
+            GTEST_SKIP() << "JIT is not supported on this host";
+
+        jit.set_jit(true);
+        for (auto *hart : {&interpreter, &jit})
+            hart->set_pc(kEntry);
+    }
+
+    template<std::ranges::forward_range R>
+    void add_instructions(DoubleWord pa, R &&instructions)
+    {
+        namespace ranges = std::ranges;
+
+        for (auto *hart : {&interpreter, &jit})
+        {
+            hart->memory().store(pa, ranges::begin(instructions), ranges::end(instructions));
+            hart->memory().store(pa + ranges::distance(instructions) * kInstrSize, kEbreak);
+        }
+    }
+
+    void set_reg(std::size_t i, DoubleWord value)
+    {
+        interpreter.gprs().set_reg(i, value);
+        jit.gprs().set_reg(i, value);
+    }
+
+    void run_and_compare()
+    {
+        const auto interpreter_count = interpreter.run();
+        const auto jit_count = jit.run();
+
+        EXPECT_GT(jit.jit()->translated_blocks(), 0);
+        EXPECT_EQ(jit_count, interpreter_count);
+        EXPECT_EQ(jit.get_pc(), interpreter.get_pc());
+        for (auto i : std::views::iota(0uz, RegFile::kNRegs))
+            EXPECT_EQ(jit.gprs().get_reg(i), interpreter.gprs().get_reg(i)) << fmt::format("x{}", i);
+    }
+
+    Hart interpreter;
+    Hart jit;
+};
+
+TEST_F(JITTest, Computational)
+{
+    constexpr std::array<RawInstruction, 46> kInstructions = {
+        0b0000000'00010'00001'000'00011'0110011, // add x3, x1, x2
+        0b0100000'00001'00010'000'00100'0110011, // sub x4, x2, x1
+        0b0000000'00010'00001'001'00101'0110011, // sll x5, x1, x2
+        0b0000000'00010'00001'101'00110'0110011, // srl x6, x1, x2
+        0b0100000'00010'00001'101'00111'0110011, // sra x7, x1, x2
+        0b0000000'00010'00001'010'01000'0110011, // slt x8, x1, x2
+        0b0000000'00010'00001'011'01001'0110011, // sltu x9, x1, x2
+        0b0000000'00011'00001'000'01010'0111011, // addw x10, x1, x3
+        0b0100000'00010'00100'000'01011'0111011, // subw x11, x4, x2
+        0b0000000'00100'00011'001'01100'0111011, // sllw x12, x3, x4
+        0b0000000'00101'00001'101'01101'0111011, // srlw x13, x1, x5
+        0b0100000'00010'00111'101'01110'0111011, // sraw x14, x7, x2
+        0b100000000000'00001'000'01111'0010011,  // addi x15, x1, -2048
+        0b111111111111'00100'010'10000'0010011,  // slti x16, x4, -1
+        0b111111111111'00100'011'10001'0010011,  // sltiu x17, x4, -1
+        0b000000'010001'00011'001'10010'0010011, // slli x18, x3, 17
+        0b000000'000011'00011'101'10011'0010011, // srli x19, x3, 3
+        0b010000'111111'00111'101'10100'0010011, // srai x20, x7, 63
+        0b011111111111'00011'000'10101'0011011,  // addiw x21, x3, 2047
+        0b0000000'11111'00011'001'10110'0011011, // slliw x22, x3, 31
+        0b0000000'00111'00001'101'10111'0011011, // srliw x23, x1, 7
+        0b0100000'00001'00001'101'11000'0011011, // sraiw x24, x1, 1
+        0b111111111111'00100'100'11001'0010011,  // xori x25, x4, -1
+        0b10000000000000000000'11010'0110111,    // lui x26, 0x80000
+        0b11111111111111111111'11011'0010111,    // auipc x27, 0xfffff
+        0b0000000'10010'00011'111'00001'0110011, // and x1, x3, x18
+        0b0000000'10111'10011'110'00010'0110011, // or x2, x19, x23
+        0b0000000'11001'00001'100'00001'0110011, // xor x1, x1, x25
+        0b000000111111'00010'111'00010'0010011,  // andi x2, x2, 63
+        0b00000000100000000000'11100'1101111,    // jal x28, 8
+        0b000000000001'00010'000'00010'0010011,  // addi x2, x2, 1
+        0b00000000000000000000'11101'0010111,    // auipc x29, 0
+        0b000000001100'11101'000'11110'1100111,  // jalr x30, 12(x29)
+        0b000000000010'00010'000'00010'0010011,  // addi x2, x2, 2
+        0b0000000'00100'00011'110'01000'1100011, // bltu x3, x4, 8
+        0b000000000101'00011'100'00011'0010011,  // xori x3, x3, 5
+        0b0000000'00000'00111'101'01000'1100011, // bge x7, x0, 8
+        0b000000000111'00001'000'00001'0010011,  // addi x1, x1, 7
+        0b0000000'00010'00001'100'01000'1100011, // blt x1, x2, 8
+        0b000000000011'00010'000'00010'0010011,  // addi x2, x2, 3
+        0b0000000'00010'00001'111'01000'1100011, // bgeu x1, x2, 8
+        0b000000001011'00001'000'00001'0010011,  // addi x1, x1, 11
+        0b0000000'01001'01000'000'01000'1100011, // beq x8, x9, 8
+        0b000000001101'00001'000'00001'0010011,  // addi x1, x1, 13
+        0b111111111111'11111'000'11111'0010011,  // addi x31, x31, -1
+        0b1111010'00000'11111'001'01101'1100011  // bne x31, x0, -180
+    };
+
+    add_instructions(kEntry, kInstructions);
+
+    set_reg(1, 0x8123456789abcdef);
+    set_reg(2, 0x13);
+    set_reg(31, 100);
+
+    run_and_compare();
+}
+
+// word shifts ignore the upper halves of their operands
+TEST_F(JITTest, WordShifts)
+{
+    constexpr std::array<RawInstruction, 6> kInstructions = {
+        0b0000000'00010'00001'101'00011'0111011, // srlw x3, x1, x2
+        0b0100000'00010'00001'101'00100'0111011, // sraw x4, x1, x2
+        0b0000000'00100'00001'101'00101'0011011, // srliw x5, x1, 4
+        0b0100000'00100'00001'101'00110'0011011, // sraiw x6, x1, 4
+        0b111111111111'11111'000'11111'0010011,  // addi x31, x31, -1
+        0b1111111'00000'11111'001'01101'1100011  // bne x31, x0, -20
+    };
+
+    add_instructions(kEntry, kInstructions);
+
+    set_reg(1, 0x12345678'f0000000);
+    set_reg(2, 32 + 4);
+    set_reg(31, 100);
+
+    run_and_compare();
+
+    EXPECT_EQ(jit.gprs().get_reg(3), 0x0f000000);
+    EXPECT_EQ(jit.gprs().get_reg(4), 0xffffffff'ff000000);
+    EXPECT_EQ(jit.gprs().get_reg(5), 0x0f000000);
+    EXPECT_EQ(jit.gprs().get_reg(6), 0xffffffff'ff000000);
+}
+
+// operands are forwarded from the result of the preceding instruction
+TEST_F(JITTest, ForwardedValues)
+{
+    constexpr std::array<RawInstruction, 10> kInstructions = {
+        0b000000000011'00001'000'00101'0010011,  // addi x5, x1, 3
+        0b0000000'00101'00101'000'00110'0110011, // add x6, x5, x5
+        0b0100000'00101'00110'000'00101'0110011, // sub x5, x6, x5
+        0b0000000'00101'00110'100'00111'0110011, // xor x7, x6, x5
+        0b0000000'00111'00111'010'01000'0110011, // slt x8, x7, x7
+        0b0000000'00111'00101'001'01001'0111011, // sllw x9, x5, x7
+        0b111111111111'01001'000'01001'0011011,  // addiw x9, x9, -1
+        0b0000000'01001'00001'000'00001'0110011, // add x1, x1, x9
+        0b111111111111'11111'000'11111'0010011,  // addi x31, x31, -1
+        0b1111110'00000'11111'001'11101'1100011  // bne x31, x0, -36
+    };
+
+    add_instructions(kEntry, kInstructions);
+
+    set_reg(1, 0x0123456789abcdef);
+    set_reg(31, 100);
+
+    run_and_compare();
+}
+
+// the trace is formed along the not taken bltu, which is taken on the second half of iterations
+TEST_F(JITTest, SideExits)
+{
+    constexpr DoubleWord kIterations = 64;
+
+    constexpr std::array<RawInstruction, 5> kInstructions = {
+        0b111111111111'00101'000'00101'0010011,  // addi x5, x5, -1
+        0b0000000'01010'00101'110'01000'1100011, // bltu x5, x10, 8
+        0b000000000001'00110'000'00110'0010011,  // addi x6, x6, 1
+        0b0000000'00101'00111'000'00111'0110011, // add x7, x7, x5
+        0b1111111'00000'00101'001'10001'1100011  // bne x5, x0, -16
+    };
+
+    add_instructions(kEntry, kInstructions);
+
+    set_reg(5, kIterations);
+    set_reg(10, kIterations / 2);
+
+    run_and_compare();
+
+    EXPECT_EQ(jit.gprs().get_reg(6), kIterations / 2);
+    EXPECT_EQ(jit.gprs().get_reg(7), kIterations * (kIterations - 1) / 2);
+}
+
+// bltu is first taken when the block is promoted: the trace doesn't follow it
+TEST_F(JITTest, MinorityDirection)
+{
+    constexpr DoubleWord kIterations = 64;
+
+    constexpr std::array<RawInstruction, 5> kInstructions = {
+        0b111111111111'00101'000'00101'0010011,  // addi x5, x5, -1
+        0b0000000'01010'00101'110'01000'1100011, // bltu x5, x10, 8
+        0b000000000001'00110'000'00110'0010011,  // addi x6, x6, 1
+        0b0000000'00101'00111'000'00111'0110011, // add x7, x7, x5
+        0b1111111'00000'00101'001'10001'1100011  // bne x5, x0, -16
+    };
+
+    add_instructions(kEntry, kInstructions);
+
+    for (auto *hart : {&interpreter, &jit})
+        hart->set_tier_thresholds({.decoded = 3, .native = 16});
+    set_reg(5, kIterations);
+    set_reg(10, kIterations - 2);
+
+    run_and_compare();
+
+    EXPECT_EQ(jit.gprs().get_reg(6), 2);
+    EXPECT_EQ(jit.gprs().get_reg(7), kIterations * (kIterations - 1) / 2);
+}
+
+TEST_F(JITTest, FusedInstructions)
+{
+    constexpr DoubleWord kIterations = 64;
+    constexpr std::array<RawInstruction, 14> kInstructions = {
+        0b00010010001101000101'01010'0110111,    // lui x10, 0x12345
+        0b011001111000'01010'000'01010'0010011,  // addi x10, x10, 0x678
+        0b10000000000000000000'01011'0110111,    // lui x11, 0x80000
+        0b111111111111'01011'000'01011'0011011,  // addiw x11, x11, -1
+        0b000000'100000'01111'001'01100'0010011, // slli x12, x15, 32
+        0b000000'100000'01100'101'01100'0010011, // srli x12, x12, 32
+        0b00000000000000000000'01101'0010111,    // auipc x13, 0
+        0b000001000000'01101'011'01110'0000011,  // ld x14, 64(x13)
+        0b00000000000000000000'00001'0010111,    // auipc x1, 0
+        0b000000001100'00001'000'00001'1100111,  // jalr x1, 12(x1)
+        0b000000000001'00111'000'00111'0010011,  // addi x7, x7, 1
+        0b111111111111'00101'000'00101'0010011,  // addi x5, x5, -1
+        0b0000000'00101'00000'011'00110'0110011, // sltu x6, x0, x5
+        0b1111110'00000'00110'001'01101'1100011  // bne x6, x0, -52
+    };
+
+    add_instructions(kEntry, kInstructions);
+    for (auto *hart : {&interpreter, &jit})
+        hart->memory().store(kEntry + 6 * kInstrSize + 64, DoubleWord{0x0123456789abcdef});
+
+    set_reg(5, kIterations);
+    set_reg(15, 0xfedcba9876543210);
+
+    run_and_compare();
+
+    EXPECT_EQ(jit.gprs().get_reg(7), 0);
+    EXPECT_EQ(jit.gprs().get_reg(12), 0x76543210);
+    EXPECT_EQ(jit.gprs().get_reg(14), 0x0123456789abcdef);
+}
+
+TEST_F(JITTest, PreciseExceptions)
+{
+    if constexpr (kUserISA)
+        GTEST_SKIP() << "the exception handler needs the privileged architecture";
+
+    constexpr DoubleWord kPageSize = Memory::kPageSize;
+    constexpr DoubleWord kRootPPN = 1;
+    constexpr DoubleWord kCodePPN = 0x100;
+    constexpr DoubleWord kDataVA = 0x80000;
+    constexpr DoubleWord kIterations = 32;
+
+    // ld faults on the last iterations, when x12 points to the unmapped page following kDataVA
+    constexpr std::array<RawInstruction, 7> kInstructions = {
+        0b111111111111'00101'000'00101'0010011,  // addi x5, x5, -1
+        0b000000000100'00101'011'01011'0010011,  // sltiu x11, x5, 4
+        0b000000'001100'01011'001'01011'0010011, // slli x11, x11, 12
+        0b0000000'01011'01000'000'01100'0110011, // add x12, x8, x11
+        0b000000000000'01100'011'00111'0000011,  // ld x7, 0(x12)
+        0b0000000'00101'00110'000'00110'0110011, // add x6, x6, x5
+        0b1111111'00000'00101'001'01001'1100011  // bne x5, x0, -24
+    };
+
+    // skips the faulting instruction
+    constexpr std::array<RawInstruction, 4> kExceptionHandler = {
+        0b001101000001'00000'010'01001'1110011,  // csrrs x9, mepc, x0
+        0b000000000100'01001'000'01001'0010011,  // addi x9, x9, 4
+        0b001101000001'01001'001'00000'1110011,  // csrrw x0, mepc, x9
+        0b0011000'00010'00000'000'00000'1110011  // mret
+    };
+
+    add_instructions(kCodePPN * kPageSize, kInstructions);
+    for (auto *hart : {&interpreter, &jit})
+    {
+        // mtvec is 0
+        hart->memory().store(0, kExceptionHandler.begin(), kExceptionHandler.end());
+
+        SATP satp;
+        satp.set_mode(SATP::Mode::kSv39);
+        satp.set_ppn(kRootPPN);
+        hart->csrs().set_satp(satp);
+
+        test::PageTables page_tables{hart->memory(), kRootPPN}; // used in M mode
+        page_tables.map(kEntry, kCodePPN, /* w = */ false, /* x = */ true);
+        page_tables.map(kDataVA, kCodePPN + 1, /* w = */ true, /* x = */ false);
+    }
+
+    set_reg(5, kIterations);
+    set_reg(8, kDataVA);
+
+    run_and_compare();
+
+    EXPECT_EQ(jit.gprs().get_reg(6), kIterations * (kIterations - 1) / 2);
+    EXPECT_EQ(jit.csrs().get_mepc(), interpreter.csrs().get_mepc());
+    EXPECT_EQ(jit.csrs().get_mepc(), kEntry + 5 * kInstrSize); // the handler has skipped ld
+    EXPECT_EQ(jit.csrs().get_mcause().get_cause(), std::pair(+MCause::kLoadPageFault, false));
+}
+
+// translated code that has been overwritten is dropped
+TEST_F(JITTest, FenceI)
+{
+    constexpr DoubleWord kIterations = 64;
+    constexpr RawInstruction kAddi2 = 0b000000000010'00111'000'00111'0010011; // addi x7, x7, 2
+    constexpr std::array<RawInstruction, 6> kInstructions = {
+        0b000000000001'00111'000'00111'0010011,  // addi x7, x7, 1
+        0b111111111111'00101'000'00101'0010011,  // addi x5, x5, -1
+        0b0000000'01001'00101'001'01100'1100011, // bne x5, x9, 12
+        0b0000000'01000'01010'010'00000'0100011, // sw x8, 0(x10)
+        0b000000000000'00000'001'00000'0001111,  // fence.i
+        0b1111111'00000'00101'001'01101'1100011  // bne x5, x0, -20
+    };
+
+    add_instructions(kEntry, kInstructions);
+    set_reg(5, kIterations);
+    set_reg(8, kAddi2);
+    set_reg(9, kIterations / 2);
+    set_reg(10, kEntry);
+
+    run_and_compare();
+
+    EXPECT_EQ(jit.gprs().get_reg(7), kIterations / 2 * 1 + kIterations / 2 * 2);
+}
+
+// the code buffer is reused after flushes, so it only has to hold the code of an outer iteration
+TEST_F(JITTest, CodeBufferReuse)
+{
+    constexpr DoubleWord kFlushes = 64;
+    constexpr DoubleWord kInnerIterations = 256;
+    constexpr std::array<RawInstruction, 7> kInstructions = {
+        0b000000000000'00000'001'00000'0001111,  // fence.i
+        0b000100000000'00000'000'00110'0010011,  // addi x6, x0, 256
+        0b000000000001'00111'000'00111'0010011,  // addi x7, x7, 1
+        0b111111111111'00110'000'00110'0010011,  // addi x6, x6, -1
+        0b1111111'00000'00110'001'11001'1100011, // bne x6, x0, -8
+        0b111111111111'00101'000'00101'0010011,  // addi x5, x5, -1
+        0b1111111'00000'00101'001'01001'1100011  // bne x5, x0, -24
+    };
+
+    jit.set_jit(false);
+    jit.set_jit(true, /* code_buffer_size = */ 1024); // a few times the code of an iteration
+
+    add_instructions(kEntry, kInstructions);
+    set_reg(5, kFlushes);
+
+    run_and_compare();
+
+    EXPECT_EQ(jit.gprs().get_reg(7), kFlushes * kInnerIterations);
+    EXPECT_GE(jit.bb_cache_flushes(), kFlushes);
+    EXPECT_GE(jit.tier_executions(Hart::Tier::kNative), kFlushes * kInnerIterations / 2);
+}
@@ -0,0 +1,334 @@
+#include <array>
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "yarvs/common.hpp"
+
+#include "yarvs/memory/memory.hpp"
+
+#include "yarvs/privileged/cs_regfile.hpp"
+
+#include "yarvs/privileged/machine/mcause.hpp"
+
+#include "yarvs/privileged/supervisor/satp.hpp"
+
+#include "page_tables.hpp"
+
+using namespace yarvs;
+
+class MemoryTest : public testing::Test
+{
+protected:
+
+    static constexpr DoubleWord kPageSize = Memory::kPageSize;
+    static constexpr DoubleWord kRootPPN = 1;
+    static constexpr DoubleWord kVA = 0x42000;
+
+    MemoryTest()
+    {
+        SATP satp;
+        satp.set_mode(SATP::Mode::kSv39);
+        satp.set_ppn(kRootPPN);
+        csrs.set_satp(satp);
+    }
+
+    // maps page va onto physical page ppn (see test::PageTables); shall be called in M mode
+    void map(DoubleWord va, DoubleWord ppn, bool w, Byte level = 0)
+    {
+        page_tables.map(va, ppn, w, /* x = */ false, level);
+    }
+
+    // changes the privilege level without flushing the TLB
+    void switch_priv_level(PrivilegeLevel level)
+    {
+        priv_level = level;
+        mem.select_access_path();
+    }
+
+    CSRegFile csrs;
+    PrivilegeLevel priv_level = PrivilegeLevel::kMachine;
+    Memory mem{csrs, priv_level};
+    test::PageTables page_tables{mem, kRootPPN};
+};
+
+TEST_F(MemoryTest, TLBHit)
+{
+    constexpr DoubleWord kPPN = 0x100;
+
+    map(kVA, kPPN, /* w = */ true);
+    ASSERT_TRUE(mem.store(kPPN * kPageSize + 8, DoubleWord{42}).has_value());
+
+    priv_level = PrivilegeLevel::kUser;
+    mem.flush_tlb();
+
+    const auto misses = mem.tlb_misses();
+    EXPECT_EQ(mem.load<DoubleWord>(kVA + 8), 42);
+    EXPECT_EQ(mem.tlb_misses(), misses + 1);
+
+    const auto hits = mem.tlb_hits();
+    EXPECT_EQ(mem.load<Byte>(kVA + 8), 42);
+    EXPECT_EQ(mem.tlb_hits(), hits + 1);
+    EXPECT_EQ(mem.tlb_misses(), misses + 1);
+}
+
+TEST_F(MemoryTest, TLBPermissions)
+{
+    constexpr DoubleWord kPPN = 0x100;
+
+    map(kVA, kPPN, /* w = */ false);
+
+    priv_level = PrivilegeLevel::kUser;
+    mem.flush_tlb();
+
+    EXPECT_TRUE(mem.load<DoubleWord>(kVA).has_value());
+
+    const auto res = mem.store(kVA, DoubleWord{42});
+    ASSERT_FALSE(res.has_value());
+    EXPECT_EQ(res.error(), MCause::Exception::kStoreAMOPageFault);
+}
+
+TEST_F(MemoryTest, TLBFlush)
+{
+    constexpr DoubleWord kOldPPN = 0x100;
+    constexpr DoubleWord kNewPPN = 0x200;
+
+    map(kVA, kOldPPN, /* w = */ true);
+    ASSERT_TRUE(mem.store(kOldPPN * kPageSize, DoubleWord{1}).has_value());
+    ASSERT_TRUE(mem.store(kNewPPN * kPageSize, DoubleWord{2}).has_value());
+
+    priv_level = PrivilegeLevel::kUser;
+    mem.flush_tlb();
+    EXPECT_EQ(mem.load<DoubleWord>(kVA), 1);
+
+    priv_level = PrivilegeLevel::kMachine;
+    mem.flush_tlb();
+    map(kVA, kNewPPN, /* w = */ true);
+
+    priv_level = PrivilegeLevel::kUser;
+    mem.flush_tlb();
+    EXPECT_EQ(mem.load<DoubleWord>(kVA), 2);
+}
+
+TEST_F(MemoryTest, SFenceVMAPage)
+{
+    constexpr DoubleWord kOtherVA = kVA + kPageSize;
+
+    map(kVA, 0x100, /* w = */ true);
+    map(kOtherVA, 0x101, /* w = */ true);
+    ASSERT_TRUE(mem.store(0x100 * kPageSize, DoubleWord{1}).has_value());
+    ASSERT_TRUE(mem.store(0x101 * kPageSize, DoubleWord{1}).has_value());
+    ASSERT_TRUE(mem.store(0x200 * kPageSize, DoubleWord{2}).has_value());
+
+    priv_level = PrivilegeLevel::kUser;
+    mem.flush_tlb();
+    EXPECT_EQ(mem.load<DoubleWord>(kVA), 1);
+    EXPECT_EQ(mem.load<DoubleWord>(kOtherVA), 1);
+
+    // page tables are modified without flushing the TLB, as a guest would do before SFENCE.VMA
+    switch_priv_level(PrivilegeLevel::kMachine);
+    map(kVA, 0x200, /* w = */ true);
+    map(kOtherVA, 0x200, /* w = */ true);
+    switch_priv_level(PrivilegeLevel::kUser);
+
+    mem.sfence_vma(kVA, std::nullopt);
+    EXPECT_EQ(mem.load<DoubleWord>(kVA), 2);
+    EXPECT_EQ(mem.load<DoubleWord>(kOtherVA), 1); // stale translation is still cached
+
+    mem.sfence_vma(std::nullopt, std::nullopt);
+    EXPECT_EQ(mem.load<DoubleWord>(kOtherVA), 2);
+}
+
+// all the pages of a superpage are invalidated by fencing any of them
+TEST_F(MemoryTest, SFenceVMASuperpage)
+{
+    constexpr DoubleWord kMegapageSize = kPageSize << 9;
+    constexpr DoubleWord kMegaVA = 0x4000'0000;
+    constexpr DoubleWord kOldPPN = 0x200;
+    constexpr DoubleWord kNewPPN = 0x400;
+    constexpr DoubleWord kOffset = 5 * kPageSize;
+
+    map(kMegaVA, kOldPPN, /* w = */ true, /* level = */ 1);
+    ASSERT_TRUE(mem.store(kOldPPN * kPageSize, DoubleWord{1}).has_value());
+    ASSERT_TRUE(mem.store(kOldPPN * kPageSize + kOffset, DoubleWord{1}).has_value());
+    ASSERT_TRUE(mem.store(kNewPPN * kPageSize + kOffset, DoubleWord{2}).has_value());
+
+    priv_level = PrivilegeLevel::kUser;
+    mem.flush_tlb();
+    EXPECT_EQ(mem.load<DoubleWord>(kMegaVA), 1);
+    EXPECT_EQ(mem.load<DoubleWord>(kMegaVA + kOffset), 1);
+
+    switch_priv_level(PrivilegeLevel::kMachine);
+    map(kMegaVA, kNewPPN, /* w = */ true, /* level = */ 1);
+    switch_priv_level(PrivilegeLevel::kUser);
+
+    mem.sfence_vma(kMegaVA + kMegapageSize - kPageSize, std::nullopt);
+    EXPECT_EQ(mem.load<DoubleWord>(kMegaVA + kOffset), 2);
+}
+
+TEST_F(MemoryTest, SFenceVMAASID)
+{
+    constexpr HalfWord kASID = 1;
+    constexpr HalfWord kOtherASID = 2;
+
+    SATP satp = csrs.get_satp();
+    satp.set_asid(kASID);
+    csrs.set_satp(satp);
+
+    map(kVA, 0x100, /* w = */ true);
+    ASSERT_TRUE(mem.store(0x100 * kPageSize, DoubleWord{1}).has_value());
+    ASSERT_TRUE(mem.store(0x200 * kPageSize, DoubleWord{2}).has_value());
+
+    priv_level = PrivilegeLevel::kUser;
+    mem.flush_tlb();
+    EXPECT_EQ(mem.load<DoubleWord>(kVA), 1);
+
+    switch_priv_level(PrivilegeLevel::kMachine);
+    map(kVA, 0x200, /* w = */ true);
+    switch_priv_level(PrivilegeLevel::kUser);
+
+    mem.sfence_vma(std::nullopt, kOtherASID);
+    EXPECT_EQ(mem.load<DoubleWord>(kVA), 1);
+
+    mem.sfence_vma(kVA, kASID);
+    EXPECT_EQ(mem.load<DoubleWord>(kVA), 2);
+}
+
+// the mode of satp is only looked at when the access path is selected
+TEST_F(MemoryTest, AccessPath)
+{
+    constexpr DoubleWord kPPN = 0x100;
+
+    map(kVA, kPPN, /* w = */ true);
+    ASSERT_TRUE(mem.store(kPPN * kPageSize, DoubleWord{1}).has_value());
+    ASSERT_TRUE(mem.store(kVA, DoubleWord{2}).has_value());
+
+    priv_level = PrivilegeLevel::kUser;
+    mem.flush_tlb();
+    EXPECT_EQ(mem.load<DoubleWord>(kVA), 1);
+
+    SATP satp = csrs.get_satp();
+    satp.set_mode(SATP::Mode::kBare);
+    csrs.set_satp(satp);
+    EXPECT_EQ(mem.load<DoubleWord>(kVA), 1);
+
+    mem.flush_tlb();
+    EXPECT_EQ(mem.load<DoubleWord>(kVA), 2);
+
+    // walked as Sv48 tables, the Sv39 ones do not map kVA
+    satp.set_mode(SATP::Mode::kSv48);
+    csrs.set_satp(satp);
+    mem.flush_tlb();
+    EXPECT_FALSE(mem.load<DoubleWord>(kVA).has_value());
+}
+
+TEST_F(MemoryTest, FastMem)
+{
+    constexpr DoubleWord kPPN = 0x100;
+    constexpr DoubleWord kReadOnlyVA = kVA + kPageSize;
+
+    Memory fast_mem{csrs, priv_level, {.fastmem = true}};
+    ASSERT_TRUE(fast_mem.fastmem_enabled());
+
+    map(kVA, kPPN, /* w = */ true);
+    map(kReadOnlyVA, kPPN, /* w = */ false);
+    ASSERT_TRUE(mem.store(kPPN * kPageSize + 8, DoubleWord{42}).has_value());
+
+    // page tables are in the physical memory of mem: copy them
+    for (DoubleWord pa = 0; pa != 8 * kPageSize; pa += sizeof(DoubleWord))
+        ASSERT_TRUE(fast_mem.store(pa, mem.load<DoubleWord>(pa).value()).has_value());
+    ASSERT_TRUE(fast_mem.store(kPPN * kPageSize + 8, DoubleWord{42}).has_value());
+
+    priv_level = PrivilegeLevel::kUser;
+    fast_mem.flush_tlb();
+
+    EXPECT_EQ(fast_mem.load<DoubleWord>(kVA + 8), 42);
+    ASSERT_TRUE(fast_mem.store(kVA + 8, DoubleWord{43}).has_value());
+    EXPECT_EQ(fast_mem.load<DoubleWord>(kReadOnlyVA + 8), 43); // the same physical page
+    EXPECT_EQ(fast_mem.load<Byte>(kVA + kPageSize - 1), 0);
+
+    const auto store_res = fast_mem.store(kReadOnlyVA, DoubleWord{1});
+    ASSERT_FALSE(store_res.has_value());
+    EXPECT_EQ(store_res.error(), MCause::Exception::kStoreAMOPageFault);
+    EXPECT_EQ(fast_mem.load<DoubleWord>(kVA), 0); // the store hasn't reached memory
+
+    const auto load_res = fast_mem.load<DoubleWord>(kVA + 16 * kPageSize);
+    ASSERT_FALSE(load_res.has_value());
+    EXPECT_EQ(load_res.error(), MCause::Exception::kLoadPageFault);
+    EXPECT_FALSE(fast_mem.load<DoubleWord>(DoubleWord{1} << 40).has_value()); // not canonical
+
+    // a write to a code page is recorded once the store has left the signal handler
+    fast_mem.mark_code_page(kPPN);
+    ASSERT_FALSE(fast_mem.code_modified());
+    ASSERT_TRUE(fast_mem.store(kVA + 8, DoubleWord{43}).has_value());
+    EXPECT_EQ(fast_mem.modified_code_pages(), std::vector{kPPN});
+
+    priv_level = PrivilegeLevel::kMachine;
+    fast_mem.flush_tlb();
+    EXPECT_EQ(fast_mem.load<DoubleWord>(kPPN * kPageSize + 8), 43);
+}
+
+TEST_F(MemoryTest, WalkCache)
+{
+    map(kVA, 0x100, /* w = */ true);
+    map(kVA + kPageSize, 0x101, /* w = */ true);
+    ASSERT_TRUE(mem.store(0x101 * kPageSize, DoubleWord{1}).has_value());
+
+    priv_level = PrivilegeLevel::kUser;
+    mem.flush_tlb();
+
+    const auto misses = mem.walk_cache_misses();
+    EXPECT_EQ(mem.load<DoubleWord>(kVA), 0);
+    EXPECT_EQ(mem.walk_cache_misses(), misses + 1);
+
+    // the neighbouring page is mapped by the same leaf table
+    const auto hits = mem.walk_cache_hits(0);
+    EXPECT_EQ(mem.load<DoubleWord>(kVA + kPageSize), 1);
+    EXPECT_EQ(mem.walk_cache_hits(0), hits + 1);
+    EXPECT_EQ(mem.walk_cache_misses(), misses + 1);
+
+    // a table is cached until the next flush
+    switch_priv_level(PrivilegeLevel::kMachine);
+    map(kVA + 2 * kPageSize, 0x101, /* w = */ false);
+    switch_priv_level(PrivilegeLevel::kUser);
+    EXPECT_EQ(mem.load<DoubleWord>(kVA + 2 * kPageSize), 1);
+    EXPECT_EQ(mem.walk_cache_hits(0), hits + 2);
+
+    mem.flush_tlb();
+    EXPECT_EQ(mem.load<DoubleWord>(kVA + 2 * kPageSize), 1);
+    EXPECT_EQ(mem.walk_cache_misses(), misses + 2);
+}
+
+TEST_F(MemoryTest, PhysicalMemorySize)
+{
+    constexpr std::size_t kSize = 16 * kPageSize;
+
+    Memory small_mem{csrs, priv_level, {.phys_mem_size = kSize}};
+    EXPECT_EQ(small_mem.phys_mem_size(), kSize);
+    EXPECT_EQ(small_mem.resident_size(), 0);
+
+    ASSERT_TRUE(small_mem.store(kSize - sizeof(DoubleWord), DoubleWord{42}).has_value());
+    EXPECT_EQ(small_mem.load<DoubleWord>(kSize - sizeof(DoubleWord)), 42);
+    EXPECT_EQ(small_mem.resident_size(), kPageSize); // committed on first touch
+
+    const auto load_res = small_mem.load<DoubleWord>(kSize - sizeof(Word));
+    ASSERT_FALSE(load_res.has_value());
+    EXPECT_EQ(load_res.error(), MCause::Exception::kLoadAccessFault);
+
+    const auto store_res = small_mem.store(kSize, Byte{1});
+    ASSERT_FALSE(store_res.has_value());
+    EXPECT_EQ(store_res.error(), MCause::Exception::kStoreAMOAccessFault);
+
+    // a range store reports the first store past the end
+    constexpr std::array<Word, 2> kWords = {1, 2};
+    const auto range_res = small_mem.store(kSize - sizeof(Word), kWords.begin(), kWords.end());
+    ASSERT_FALSE(range_res.has_value());
+    EXPECT_EQ(range_res.error(), MCause::Exception::kStoreAMOAccessFault);
+    EXPECT_EQ(small_mem.load<Word>(kSize - sizeof(Word)), 1);
+
+    EXPECT_THROW((Memory{csrs, priv_level, {.phys_mem_size = kPageSize + 1}}),
+                 std::invalid_argument);
+}
@@ -0,0 +1,64 @@
+#ifndef TEST_UNIT_PAGE_TABLES_HPP
+#define TEST_UNIT_PAGE_TABLES_HPP
+
+#include <gtest/gtest.h>
+
+#include "yarvs/common.hpp"
+
+#include "yarvs/memory/memory.hpp"
+#include "yarvs/memory/pte.hpp"
+#include "yarvs/memory/virtual_address.hpp"
+
+namespace yarvs::test
+{
+
+// Builds Sv39 page tables of user pages in physical memory; shall be used in M mode
+class PageTables final
+{
+public:
+
+    PageTables(Memory &mem, DoubleWord root_ppn) noexcept
+        : mem_{mem}, root_ppn_{root_ppn}, next_table_ppn_{root_ppn + 1}
+    {}
+
+    /*
+     * Maps page va onto physical page ppn with a leaf PTE of the given level: 1 maps a megapage.
+     * Tables are allocated in the pages following the root one.
+     */
+    void map(DoubleWord va, DoubleWord ppn, bool w, bool x, Byte level = 0)
+    {
+        const VirtualAddress v = va;
+        DoubleWord a = root_ppn_ * Memory::kPageSize;
+        for (Byte i = 2; i > level; --i)
+        {
+            const auto pa = a + v.get_vpn(i) * sizeof(PTE);
+            PTE pte = mem_.load<DoubleWord>(pa).value();
+            if (!pte.get_V())
+            {
+                pte = kPointerToNextLevelPTE;
+                pte.set_ppn(next_table_ppn_++);
+                ASSERT_TRUE(mem_.store(pa, +pte).has_value());
+            }
+            a = pte.get_whole_ppn();
+        }
+
+        PTE pte = kPointerToNextLevelPTE;
+        pte.set_R(true);
+        pte.set_W(w);
+        pte.set_E(x);
+        pte.set_ppn(ppn);
+        ASSERT_TRUE(mem_.store(a + v.get_vpn(level) * sizeof(PTE), +pte).has_value());
+    }
+
+private:
+
+    static constexpr PTE kPointerToNextLevelPTE = 0b10001;
+
+    Memory &mem_;
+    DoubleWord root_ppn_;
+    DoubleWord next_table_ppn_;
+};
+
+} // namespace yarvs::test
+
+#endif // TEST_UNIT_PAGE_TABLES_HPP
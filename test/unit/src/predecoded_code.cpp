@@ -0,0 +1,70 @@
+#include <array>
+#include <bit>
+#include <cstddef>
+
+#include <gtest/gtest.h>
+
+#include "yarvs/common.hpp"
+#include "yarvs/instruction.hpp"
+#include "yarvs/predecoded_code.hpp"
+
+#include "yarvs/memory/memory.hpp"
+
+using namespace yarvs;
+
+class PredecodedCodeTest : public testing::Test
+{
+protected:
+
+    static constexpr DoubleWord kEntry = 0x42000;
+    static constexpr DoubleWord kPA = 0x7000;
+
+    static constexpr std::array<RawInstruction, 7> kCode = {
+        0x00300293, // 0x00: addi x5, x0, 3
+        0xfff28293, // 0x04: addi x5, x5, -1
+        0xfe029ee3, // 0x08: bne x5, x0, -4
+        0x008000ef, // 0x0c: jal x1, 8
+        0x00100073, // 0x10: ebreak
+        0x00008067, // 0x14: jalr x0, 0(x1)
+        0x00000013  // 0x18: nop (unreachable)
+    };
+
+    void SetUp() override
+    {
+        static_assert(std::endian::native == std::endian::little);
+        const auto *bytes = reinterpret_cast<const Byte *>(kCode.data());
+        code.add_segment(kEntry, kPA, {bytes, kCode.size() * sizeof(RawInstruction)});
+        code.recover_cfg(kEntry);
+    }
+
+    PredecodedCode code;
+};
+
+TEST_F(PredecodedCodeTest, RecoverCFG)
+{
+    EXPECT_EQ(code.n_blocks(), 5);
+
+    EXPECT_EQ(code.block_size(kEntry + 0x00), 1);
+    EXPECT_EQ(code.block_size(kEntry + 0x04), 2); // the target of bne
+    EXPECT_EQ(code.block_size(kEntry + 0x0c), 1);
+    EXPECT_EQ(code.block_size(kEntry + 0x10), 1); // the return address of jal
+    EXPECT_EQ(code.block_size(kEntry + 0x14), 1); // the target of jal
+
+    EXPECT_EQ(code.block_size(kEntry + 0x08), 0);
+    EXPECT_EQ(code.block_size(kEntry + 0x18), 0);
+}
+
+// instructions are looked up by physical address
+TEST_F(PredecodedCodeTest, Invalidation)
+{
+    const auto instr = code.find(kPA + 0x08);
+    ASSERT_TRUE(instr.has_value());
+    EXPECT_EQ(instr->id, InstrID::kBNE);
+
+    EXPECT_FALSE(code.find(kEntry + 0x08).has_value());
+    EXPECT_FALSE(code.find(kPA + kCode.size() * sizeof(RawInstruction)).has_value());
+
+    const std::array modified = {kPA / Memory::kPageSize};
+    code.invalidate_pages(modified);
+    EXPECT_FALSE(code.find(kPA + 0x08).has_value());
+}
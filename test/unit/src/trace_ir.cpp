@@ -0,0 +1,75 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include <gtest/gtest.h>
+
+#include "yarvs/common.hpp"
+#include "yarvs/decoder.hpp"
+#include "yarvs/instruction.hpp"
+
+#include "yarvs/jit/trace_ir.hpp"
+
+using namespace yarvs;
+
+class TraceIRTest : public testing::Test
+{
+protected:
+
+    static constexpr DoubleWord kEntry = 0x42000;
+
+    // instructions of a single segment
+    template<std::size_t N>
+    void build(const std::array<RawInstruction, N> &raw_instrs)
+    {
+        for (std::size_t i = 0; i != N; ++i)
+        {
+            instrs[i] = Decoder::decode(raw_instrs[i]);
+            ir.append(instrs[i], kEntry + i * sizeof(RawInstruction),
+                      static_cast<std::uint32_t>(i), std::nullopt);
+        }
+        ir.optimize();
+    }
+
+    std::array<Instruction, 8> instrs;
+    TraceIR ir;
+};
+
+TEST_F(TraceIRTest, ConstantPropagation)
+{
+    build(std::array<RawInstruction, 5>{
+        0b00000000000000000001'00101'0110111,    // lui x5, 0x1
+        0b000000000100'00101'000'00101'0010011,  // addi x5, x5, 4
+        0b0000000'00101'00101'000'00110'0110011, // add x6, x5, x5
+        0b0000000'00001'00110'000'00111'0110011, // add x7, x6, x1
+        0b0000000'00000'00110'000'01000'1100011  // beq x6, x0, 8
+    });
+
+    const auto nodes = ir.nodes();
+    EXPECT_EQ(nodes[1].result, 0x1004);
+    EXPECT_EQ(nodes[2].result, 0x2008);
+    EXPECT_EQ(nodes[3].rs1_value, 0x2008);
+    EXPECT_EQ(nodes[3].rs2_value, std::nullopt);
+    EXPECT_EQ(nodes[3].result, std::nullopt);
+    EXPECT_EQ(nodes[4].taken, false);
+}
+
+TEST_F(TraceIRTest, DeadWrites)
+{
+    build(std::array<RawInstruction, 6>{
+        0b000000000001'00001'000'00101'0010011,  // addi x5, x1, 1
+        0b000000000011'00001'000'00000'0010011,  // addi x0, x1, 3
+        0b000000000010'00010'000'00101'0010011,  // addi x5, x2, 2
+        0b000000000001'00001'000'00110'0010011,  // addi x6, x1, 1
+        0b000000000000'00101'011'00111'0000011,  // ld x7, 0(x5)
+        0b000000000001'00010'000'00110'0010011   // addi x6, x2, 1
+    });
+
+    const auto nodes = ir.nodes();
+    EXPECT_TRUE(nodes[0].dead);  // overwritten before being read
+    EXPECT_TRUE(nodes[1].dead);  // writes x0
+    EXPECT_FALSE(nodes[2].dead);
+    EXPECT_FALSE(nodes[3].dead); // ld may trap and leave the trace with x6 written
+    EXPECT_FALSE(nodes[5].dead);
+}